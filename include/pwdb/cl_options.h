@@ -37,6 +37,13 @@ struct cl_options
     std::string gpg_homedir;
     std::string infile;
     std::string outfile;
+    bool read_only;
+    bool prefetch;
+    bool autosave;
+    bool pager;
+    std::string output;
+    std::string merge_policy;
+    bool stats;
 };
 
 cl_options cl_handle(int argc, const char *argv[]);
@@ -23,7 +23,9 @@
 ***/
 
 #include "pwdb/pwdb.pb.h"
+#include "pwdb/name_trie.h"
 #include <map>
+#include <optional>
 #include <set>
 #include <vector>
 #include <string>
@@ -31,6 +33,8 @@
 
 namespace pwdb {
 
+// Append rcd to buf, or write it to out, indented by indent spaces
+void stream_out(const pb::Record &rcd, std::string &buf, unsigned indent=0);
 void stream_out(const pb::Record &rcd, std::ostream &out, unsigned indent=0);
 
 class db
@@ -41,6 +45,10 @@ public:
 
 private:
     pb::DB pb_db;
+    // Record and tag names for completion, built on first use and from then
+    // on kept up to date by each change to them
+    mutable std::optional<name_trie> names_;
+    mutable std::optional<name_trie> tag_names_;
 
     db(const db &) = default;
 
@@ -57,7 +65,12 @@ public:
     db(db &&) = default;
     db &operator=(const db &) = delete;
     db &operator=(db &&) = default;
-    db &operator=(pb::DB &&p) { pb_db = std::move(p); return *this; }
+    db &operator=(pb::DB &&p) {
+        pb_db = std::move(p);
+        names_.reset();
+        tag_names_.reset();
+        return *this;
+    }
 
     auto copy(void) const->db
         { return db(*this); }
@@ -67,10 +80,22 @@ public:
         { return pb_db.uid(); }
     void uid(const std::string &id)
         { *pb_db.mutable_uid() = id; }
-    void add(const std::string &name, const pb::Record &rcd)
-        { records()[name] = rcd; }
-    void add(const std::string &name, pb::Record &&rcd = pb::Record{})
-        { records()[name] = std::move(rcd); }
+    void merkle(pb::Merkle &&tree)
+        { *pb_db.mutable_merkle() = std::move(tree); }
+    // Key fingerprints pinned for the uid or a recipient
+    auto key_pin(const std::string &recipient) const->std::vector<std::string>;
+    void key_pin(const std::string &recipient,
+            const std::vector<std::string> &fprs);
+    void add(const std::string &name, const pb::Record &rcd) {
+        records()[name] = rcd;
+        if(names_)
+            names_->insert(name);
+    }
+    void add(const std::string &name, pb::Record &&rcd = pb::Record{}) {
+        records()[name] = std::move(rcd);
+        if(names_)
+            names_->insert(name);
+    }
     auto remove(const std::string &name)->unsigned;
     auto count(const std::string &name) const
         { return pb_db.records().count(name); }
@@ -79,30 +104,54 @@ public:
     auto at(const std::string &name) const->const pb::Record&;
     auto get_data(const std::string &name) const->const std::string&
         { return pb_db.records().at(name).data(); }
-    void set_data(const std::string &name, const std::string &data) {
+    // Setting the payload clears the key fingerprints, unless given
+    void set_data(const std::string &name, const std::string &data,
+            const std::vector<std::string> &key_fprs = {}) {
         pb_db.mutable_records()->at(name).set_data(data);
+        this->key_fprs(name, key_fprs);
     }
-    void set_data(const std::string &name, std::string &&data) {
+    void set_data(const std::string &name, std::string &&data,
+            const std::vector<std::string> &key_fprs = {}) {
         pb_db.mutable_records()->at(name).set_data(std::move(data));
+        this->key_fprs(name, key_fprs);
+    }
+    void key_fprs(const std::string &name,
+            const std::vector<std::string> &key_fprs) {
+        auto &rcd = pb_db.mutable_records()->at(name);
+        rcd.clear_key_fpr();
+        for(const auto &fpr: key_fprs)
+            rcd.add_key_fpr(fpr);
     }
     auto get_store(const std::string &name) const->const pwdb::pb::Store&
         { return pb_db.records().at(name).store(); }
     void set_store(const std::string &name, const pwdb::pb::Store &store) {
-        *(pb_db.mutable_records()->at(name).mutable_store()) = store;
+        auto &rcd = pb_db.mutable_records()->at(name);
+        *rcd.mutable_store() = store;
+        rcd.clear_key_fpr();
     }
     void set_store(const std::string &name, pwdb::pb::Store &&store) {
-        *(pb_db.mutable_records()->at(name).mutable_store()) = std::move(store);
+        auto &rcd = pb_db.mutable_records()->at(name);
+        *rcd.mutable_store() = std::move(store);
+        rcd.clear_key_fpr();
     }
     bool entag(const std::string &name, const std::string &tag);
     bool detag(const std::string &name, const std::string &tag);
     auto at_tag(const std::string &tag) const->std::vector<std::string>;
     bool comment(const std::string &name, const std::string &cmt);
+    bool recipients(const std::string &name,
+            const std::vector<std::string> &recipients);
     auto begin(void) const { return pb_db.records().cbegin(); }
     auto end(void) const { return pb_db.records().cend(); }
     auto size(void) const { return pb_db.records_size(); }
     auto tags(void) const->std::set<std::string>;
     auto tags(const std::string &name) const->std::set<std::string>;
+    // Record or tag names starting with prefix, in order
+    auto complete_name(const std::string &prefix) const->
+        std::vector<std::string>;
+    auto complete_tag(const std::string &prefix) const->
+        std::vector<std::string>;
     auto pb(void) const->const pwdb::pb::DB& { return pb_db; }
+    void stream_out(std::string &buf, unsigned indent=0) const;
     void stream_out(std::ostream &out, unsigned indent=0) const;
 };
 
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_db_file_h_included
+#define pwdb_db_file_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "pwdb/pwdb.pb.h"
+#include "gpgh/gpg_helper.h"
+#include <istream>
+#include <list>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pwdb {
+
+//=============================================================================
+// Chunked pwdb file format
+// The DB is serialized deterministically and split into chunks between
+// records, at boundaries picked by a hash of the record name, so an edit
+// changes only the chunk holding the record. Each chunk is encrypted on its
+// own, and the signed index of chunk plaintext digests covers them all. Since
+// a chunk with unchanged plaintext is written back with its ciphertext from
+// the chunk_cache, saving an unchanged vault rewrites only the small index,
+// and rsync style delta transfers move little more than the changed chunks.
+// Chunks are encrypted and decrypted concurrently, one gpgme context per core.
+//
+// Layout, integers big endian:
+//      magic
+//      u32 count               index plus chunks
+//      u64 size[count]         ciphertext sizes, index first
+//      index ciphertext        signed pb::ChunkIndex
+//      chunk ciphertexts       first the uid, tags, key pins and merkle,
+//                              then records
+//=============================================================================
+
+// Chunk ciphertexts by plaintext digest, valid for the recipients they were
+// encrypted to. A file read is taken to be encrypted to its uid, although
+// after a key rotation it may be encrypted to old keys of the uid, so recrypt
+// must not fill a cache from the file it reads.
+struct chunk_cache
+{
+    std::vector<std::string> recipients;
+    std::unordered_map<std::string, std::string> ciphertext;
+
+    // Add the chunks of other, replacing all if for other recipients
+    void merge(chunk_cache &&other) {
+        if(other.recipients != recipients)
+            *this = std::move(other);
+        else
+            ciphertext.merge(other.ciphertext);
+    }
+};
+
+struct verified_db
+{
+    pb::DB pb;
+    std::list<gpgh::sig_verify_result> sigs;
+};
+
+// True if in holds a chunked file, leaving the read position unchanged
+bool is_chunked(std::istream &in);
+
+// Read a pwdb file in the chunked or whole file format from the seekable in.
+// Ciphertexts of the chunks are added to cache, if given, for write_db to
+// reuse.
+auto read_db(gpgh::context &ctx, std::istream &in,
+        chunk_cache *cache = nullptr)->verified_db;
+
+// Write a chunked pwdb file, signing the index with the signers of ctx.
+// Chunks are encrypted by contexts on the GnuPG home directory of ctx.
+void write_db(gpgh::context &ctx, const std::vector<std::string> &recipients,
+        const pb::DB &pb_db, std::ostream &out, chunk_cache *cache = nullptr);
+// As above, with the keys of recipients already resolved
+void write_db(gpgh::context &ctx, const std::vector<std::string> &recipients,
+        const gpgh::keylist &keys, const pb::DB &pb_db, std::ostream &out,
+        chunk_cache *cache = nullptr);
+
+} // namespace pwdb
+#endif // pwdb_db_file_h_included
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_db_merge_h_included
+#define pwdb_db_merge_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/db.h"
+#include "pwdb/sha256.h"
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pwdb {
+
+// How to resolve a record changed differently on both sides of a merge
+enum class merge_policy
+{
+    ours,       // keep our version
+    theirs,     // take their version
+    both,       // keep ours, and theirs renamed with conflict_suffix
+};
+
+constexpr auto conflict_suffix = "~conflict";
+
+struct merge_result
+{
+    std::vector<std::string> changed;   // records modified in ours
+    std::vector<std::string> conflicts; // records changed on both sides
+};
+
+bool same_record(const pb::Record &lhs, const pb::Record &rhs);
+
+// Names of the tags of each record of pb_db, sorted
+auto record_tags(const pb::DB &pb_db)->
+    std::unordered_map<std::string, std::vector<std::string>>;
+
+// Content hash of a record as stored: its payload (the ciphertext unless the
+// store is open), comment, recipients, and the sorted names of its tags
+auto record_digest(const pb::Record &rcd, const std::vector<std::string> &tags)
+    ->sha256::digest;
+
+// record_digest of every record of pb_db
+auto record_digests(const pb::DB &pb_db)->
+    std::unordered_map<std::string, sha256::digest>;
+
+// Three-way, record level merge of theirs into ours given their common base.
+// Records, tags and uid changed only in theirs are applied to ours, touching
+// nothing else, so cost is in the size of base and theirs, not in the number
+// of changes made in ours.
+auto db_merge3(db &ours, const pb::DB &base, const pb::DB &theirs,
+        merge_policy policy = merge_policy::both)->merge_result;
+
+// Whether two records with differing payloads hold the same data, typically by
+// decrypting and comparing their stores
+using same_store_fn = std::function<bool(const pb::Record &ours,
+        const pb::Record &theirs)>;
+
+// Two-way merge of theirs into ours, for copies that diverged without a known
+// common base. Records are matched by record_digest in one pass, and
+// same_store is called only for those whose payloads differ, so stores are
+// decrypted only for records that may truly conflict. With no base a removal
+// can't be told from an addition, so records and tags only in theirs are
+// added and nothing is removed.
+auto db_merge(db &ours, const pb::DB &theirs, merge_policy policy,
+        const same_store_fn &same_store)->merge_result;
+
+} // namespace pwdb
+#endif // pwdb_db_merge_h_included
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_db_merkle_h_included
+#define pwdb_db_merkle_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "pwdb/pwdb.pb.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace pwdb {
+
+//=============================================================================
+// Merkle tree over the records of a DB, kept in the signed DB so replicas can
+// be compared without decrypting any store. Records are placed in 2^depth leaf
+// buckets by a hash of their name, so trees of the same depth have the same
+// shape whatever records they hold. A leaf hashes the names and record_digest
+// of its records in name order, an inner node the hashes of its two children.
+// The names and digests of each leaf are kept with the tree, so the records
+// of differing leaves are found without hashing the names of the others.
+//=============================================================================
+
+// Depth giving around eight records per leaf bucket
+auto merkle_depth(size_t nrecords)->unsigned;
+
+auto merkle_build(const pb::DB &pb_db, unsigned depth)->pb::Merkle;
+inline auto merkle_build(const pb::DB &pb_db)->pb::Merkle
+    { return merkle_build(pb_db, merkle_depth(pb_db.records_size())); }
+
+// Root hash in hex, from the stored tree when there is one
+auto merkle_root(const pb::DB &pb_db)->std::string;
+
+// Records of theirs that differ from ours, each sorted by name
+struct db_diff
+{
+    std::vector<std::string> added;     // only in theirs
+    std::vector<std::string> removed;   // only in ours
+    std::vector<std::string> changed;   // in both, with different content
+
+    bool empty(void) const
+        { return added.empty() && removed.empty() && changed.empty(); }
+};
+
+// Walk the trees of ours and theirs from the root, descending only into
+// subtrees whose hashes differ, then compare the records of differing leaves
+// as the leaves list them. A stored tree is used when it is of the depth
+// compared at and its leaves hold as many records as its DB, otherwise it is
+// rebuilt at the depth of ours. Both are rebuilt if a differing leaf names a
+// record its DB lacks. pwdb rebuilds the stored tree on every save, so a
+// stale tree holding the same names is not looked for.
+auto merkle_diff(const pb::DB &ours, const pb::DB &theirs)->db_diff;
+
+} // namespace pwdb
+#endif // pwdb_db_merkle_h_included
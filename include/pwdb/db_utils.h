@@ -23,16 +23,116 @@
 ***/
 
 #include "pwdb/db.h"
+#include "pwdb/sha256.h"
+#include "pwdb/store_cache.h"
 #include "gpgh/gpg_helper.h"
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace pwdb {
 
+// Keyed digest of a store, serialized deterministically, and of the
+// fingerprints of the subkeys it is encrypted to. The key is random for each
+// process, so a digest tells nothing of the plaintext outside of it.
+auto store_digest(const pb::Store &store, std::vector<std::string> fprs)->
+    sha256::digest;
+
+// Keyed digest of the uid, records, tags, and key pins of pb_db, ignoring
+// the merkle tree derived from them. A changed pin makes the DB differ, so a
+// re-pin after a key rotation is saved.
+auto db_digest(const pb::DB &pb_db)->sha256::digest;
+
+// Recipients of the store of rcd in cdb: the uid, then the additional
+// recipients of rcd not already listed
+auto rcd_recipients(const db &cdb, const pb::Record &rcd)->
+    std::vector<std::string>;
+
+// Encryption keys of recipients, found by exact fingerprint from the pins in
+// cdb rather than by searching the keyring. A recipient not yet pinned, or
+// whose pinned keys are gone, revoked, or expired, as after a key rotation,
+// is searched for and pinned again. The uid must also be able to sign. Throws
+// if any recipient has no usable key.
+auto recipient_keys(gpgh::context &ctx, db &cdb,
+        const std::vector<std::string> &recipients)->gpgh::keylist;
+
+// Keys the store of rcd in cdb is encrypted to
+auto db_rcd_keys(gpgh::context &ctx, db &cdb, const pb::Record &rcd)->
+    gpgh::keylist;
+
+// Add the key of the uid of cdb as signer of ctx, returning the keys of the
+// uid to encrypt to
+auto db_add_signer(gpgh::context &ctx, db &cdb)->gpgh::keylist;
+
+// Sorted fingerprints of keys, as kept in the key pins
+auto key_fprs(const gpgh::keylist &keys)->std::vector<std::string>;
+// Sorted fingerprints of the subkeys gpg encrypts to for keys, as kept in
+// Record.key_fpr, so a rotated encryption subkey changes them even though
+// the primary key stays. A key with no usable one gives its own fingerprint.
+auto encryption_fprs(const gpgh::keylist &keys)->std::vector<std::string>;
+
 auto db_open_rcd_store(gpgh::context &ctx, const pb::Record &rcd)->
     pwdb::pb::Store;
+// Also set digest to the store_digest of the store and the fingerprints of
+// the subkeys, of those of keys, that it was encrypted to. A store not yet
+// encrypted gets a digest with no keys.
+auto db_open_rcd_store(gpgh::context &ctx, const pb::Record &rcd,
+        const gpgh::keylist &keys, sha256::digest &digest)->pwdb::pb::Store;
+// As above, taking the store of record name from cache when it holds the
+// store of the ciphertext of rcd, and adding it to cache when decrypted
+auto db_open_rcd_store(gpgh::context &ctx, const std::string &name,
+        const pb::Record &rcd, store_cache &cache)->pwdb::pb::Store;
+auto db_open_rcd_store(gpgh::context &ctx, const std::string &name,
+        const pb::Record &rcd, const gpgh::keylist &keys,
+        sha256::digest &digest, store_cache &cache)->pwdb::pb::Store;
+// As above, without needing the keys yet: set digest to the store_digest of
+// the store alone and keyids to the IDs of the keys it was decrypted with,
+// none for a store not yet encrypted, for the db_save_rcd_store taking them
+auto db_open_rcd_store(gpgh::context &ctx, const std::string &name,
+        const pb::Record &rcd, sha256::digest &digest,
+        std::vector<std::string> &keyids, store_cache &cache)->
+    pwdb::pb::Store;
 void db_save_rcd_store(gpgh::context &ctx, db &cdb, const std::string &name,
         const pwdb::pb::Store &pb_store);
-void db_recrypt_rcd_stores(gpgh::context &ctx, db &cdb);
+void db_save_rcd_store(gpgh::context &ctx, db &cdb, const std::string &name,
+        const pwdb::pb::Store &pb_store, const gpgh::keylist &keys);
+// Encrypt pb_store to keys unless its store_digest with the encryption_fprs
+// of keys equals digest, that is unless neither the store nor the subkeys it
+// is encrypted to changed since it was opened. Returns true if encrypted.
+bool db_save_rcd_store(gpgh::context &ctx, db &cdb, const std::string &name,
+        const pwdb::pb::Store &pb_store, const gpgh::keylist &keys,
+        const sha256::digest &digest);
+// As above, for a store opened with the digest and keyids of the
+// db_open_rcd_store not taking keys
+bool db_save_rcd_store(gpgh::context &ctx, db &cdb, const std::string &name,
+        const pwdb::pb::Store &pb_store, const gpgh::keylist &keys,
+        const sha256::digest &digest, const std::vector<std::string> &keyids);
+// Called by db_recrypt_rcd_stores after each record it had to check, with
+// the number checked so far and in all. Returning false stops the recrypt.
+using recrypt_progress_fn = std::function<bool(size_t done, size_t total)>;
+
+// Encrypt each record store to the keys of its recipients, skipping those
+// already encrypted to them. Records are grouped by recipients so the keys of
+// each group are looked up once. Records whose key_fpr matches the
+// encryption_fprs of the keys are skipped without being decrypted, so a
+// recrypt stopped part way resumes where it left off once the DB is saved.
+// Up to eight records are decrypted and encrypted at once on a
+// gpgh::event_loop in the gpg home of ctx, run on the calling thread, which
+// progress is also called on. Once progress returns false or a record fails
+// the records in flight are finished but no more are started. Returns the
+// number encrypted.
+auto db_recrypt_rcd_stores(gpgh::context &ctx, db &cdb,
+        const recrypt_progress_fn &progress = nullptr)->size_t;
 void db_decrypt_all_rcd_stores(gpgh::context &ctx, db &cdb);
 
+// Generator of partial pb::DB messages with record stores decrypted: the uid,
+// then one message per record, then one per tag. Merging them in order
+// rebuilds cdb without ever holding more than one decrypted store. Both ctx
+// and cdb must outlive the generator.
+using db_fragment_gen = std::function<std::optional<pb::DB>(void)>;
+auto db_decrypted_fragments(gpgh::context &ctx, const db &cdb)->
+    db_fragment_gen;
+
 } // namespace pwdb
 #endif // pwdb_db_utils_h_included
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_latency_h_included
+#define pwdb_latency_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace pwdb {
+
+//=============================================================================
+// Latency histograms
+// Of interpreter commands and gpg operations, to tell where the time of a
+// slow session goes. Buckets are powers of two of microseconds.
+//=============================================================================
+
+class latency_histogram
+{
+public:
+    using duration = std::chrono::steady_clock::duration;
+    // Bucket i counts times from 2^i us up to 2^(i+1) us, the first also
+    // those under 1us and the last all from 2^(buckets-1) us on, about 8s
+    static constexpr size_t buckets = 24;
+
+    void add(duration took);
+    auto count(void) const->size_t { return count_; }
+    auto total(void) const->duration { return total_; }
+    auto max(void) const->duration { return max_; }
+    auto bucket(size_t i) const->size_t { return counts_.at(i); }
+    // Least time counted in bucket i, but for the under 1us of the first
+    static auto bucket_floor(size_t i)->duration;
+private:
+    std::array<size_t, buckets> counts_{};
+    size_t count_{0};
+    duration total_{0};
+    duration max_{0};
+};
+
+// Histograms by name, safe to add to from several threads
+class latency_stats
+{
+public:
+    void add(const std::string &name, latency_histogram::duration took);
+    auto histograms(void) const->std::map<std::string, latency_histogram>;
+    bool empty(void) const;
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, latency_histogram> histograms_;
+};
+
+// Latencies of this process: of the commands run by the interpreters, and of
+// the gpg operations once time_gpg_ops has been called
+auto command_latency(void)->latency_stats&;
+auto gpg_latency(void)->latency_stats&;
+void time_gpg_ops(void);
+
+// took to a few significant digits, in us, ms or s
+auto format_duration(latency_histogram::duration took)->std::string;
+
+// Append a section titled title with the histograms of stats to out, each a
+// summary line and a bar for each bucket with anything counted
+void print_latency(std::string &out, std::string_view title,
+        const latency_stats &stats);
+
+} // namespace pwdb
+#endif // pwdb_latency_h_included
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_name_trie_h_included
+#define pwdb_name_trie_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pwdb {
+
+//=============================================================================
+// Set of names for prefix completion
+// A radix tree: each node holds the run of characters shared by all names
+// below it, so looking up a prefix costs its length plus the names returned,
+// however many names there are.
+//=============================================================================
+class name_trie
+{
+public:
+    name_trie(void) = default;
+    name_trie(const name_trie &other);
+    name_trie(name_trie&&) = default;
+    name_trie &operator=(const name_trie &other);
+    name_trie &operator=(name_trie&&) = default;
+
+    // True if name was not already present
+    bool insert(std::string_view name);
+    // True if name was present
+    bool erase(std::string_view name);
+    bool contains(std::string_view name) const;
+    auto size(void) const->size_t { return size_; }
+    void clear(void);
+    // Names starting with prefix, in order
+    auto complete(std::string_view prefix) const->std::vector<std::string>;
+
+private:
+    struct node
+    {
+        std::string label;      // characters following the parent's
+        bool terminal{false};   // a name ends here
+        std::vector<std::unique_ptr<node>> children;   // by first character
+
+        auto copy(void) const->std::unique_ptr<node>;
+        // Index of the child starting with c, or where it would go
+        auto child(char c) const->size_t;
+        void merge_only_child(void);
+    };
+
+    node root_;
+    size_t size_{0};
+
+    static void collect(const node &n, std::string &path,
+            std::vector<std::string> &out);
+};
+
+} // namespace pwdb
+#endif // pwdb_name_trie_h_included
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_output_format_h_included
+#define pwdb_output_format_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/db.h"
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pwdb {
+
+//=============================================================================
+// Machine readable output of interpreter commands
+// Written straight into the output buffer, strings escaped by the JSON codec,
+// with no document or reflection in between. JSON output of a command is a
+// single line. TSV fields escape tab, newline, carriage return and backslash
+// as \t, \n, \r and \\.
+//=============================================================================
+
+enum class output_format { text, json, tsv };
+
+// Format named name, throwing std::runtime_error if there is none
+auto parse_output_format(std::string_view name)->output_format;
+
+// Append s to out as a TSV field
+void write_tsv_field(std::string &out, std::string_view s);
+
+//-----------------------------------------------------------------------------
+class row_writer
+// Rows of string fields, as a JSON array of objects keyed by the column names
+// or as TSV lines
+//-----------------------------------------------------------------------------
+{
+public:
+    row_writer(std::string &out, output_format fmt,
+            std::initializer_list<std::string_view> columns);
+    row_writer(const row_writer&) = delete;
+    row_writer &operator=(const row_writer&) = delete;
+    ~row_writer();
+
+    void row(std::initializer_list<std::string_view> fields);
+private:
+    std::string &out_;
+    const output_format fmt_;
+    const std::vector<std::string_view> columns_;
+    bool first_{true};
+};
+
+// Append what dump shows of the records named, or of all records with the
+// uid and tags if names is empty. In TSV each line starts with its kind: uid,
+// record with its comment and comma separated recipients, tag with its
+// comma separated records, or missing for a name with no record.
+void write_dump(std::string &out, output_format fmt, const db &cdb,
+        const std::vector<std::string> &names);
+
+} // namespace pwdb
+#endif // pwdb_output_format_h_included
@@ -23,7 +23,20 @@
 ***/
 
 #include "gpgh/gpg_helper.h"
+#include "pwdb/util.h"
+#include "pwdb/trace.h"
+#include <google/protobuf/util/delimited_message_util.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/coded_stream.h>
 #include <sstream>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <algorithm>
+#include <climits>
+#include <deque>
+#include <vector>
 
 namespace pwdb {
 
@@ -34,6 +47,7 @@ namespace pwdb {
 template <typename PB_T>
 auto decode_data(gpgh::context &ctx, std::istream &src)->PB_T
 {
+    trace_span span{"decode_data"};
     PB_T ret;
     if(!ret.ParseFromString(ctx.decrypt(src))) {
         throw std::runtime_error(std::string("Failed to parse ") +
@@ -49,22 +63,48 @@ auto decode_data(gpgh::context &ctx, const std::string &src)->PB_T
     return decode_data<PB_T>(ctx, src_strm);
 }
 
+// Whether k may be encrypted to, and if sign, also sign
+inline bool usable_key(gpgme_key_t k, bool sign)
+{
+    return !k->revoked && !k->expired && k->can_encrypt &&
+        (sign ? k->can_sign : true);
+}
+
+inline auto encode_keys(gpgh::context &ctx,
+        const std::vector<std::string> &recipients, bool sign)->gpgh::keylist
+{
+    auto key_filter = [sign](gpgme_key_t k)->bool {
+        return usable_key(k, sign);
+    };
+    return ctx.get_keys(recipients, false, key_filter);
+}
+
+// Serialize with map entries in key order, so equal messages always give equal
+// bytes (plain serialization leaves map order unspecified)
+template <typename PB_T>
+auto serialize_deterministic(const PB_T &msg)->std::string
+{
+    std::string ret;
+    {
+        google::protobuf::io::StringOutputStream ret_strm{&ret};
+        google::protobuf::io::CodedOutputStream coded{&ret_strm};
+        coded.SetSerializationDeterministic(true);
+        if(!msg.SerializeToCodedStream(&coded)) {
+            throw std::runtime_error(std::string("Failed to serialize ") +
+                    typeid(PB_T).name());
+        }
+    }
+    return ret;
+}
+
 template <typename PB_T>
 void encode_data(gpgh::context &ctx,
         const std::vector<std::string> &recipients,
         const PB_T &msg, std::ostream &dest, bool sign=false)
 {
-    std::stringstream dec_data;
-    if(!msg.SerializeToOstream(&dec_data)) {
-        throw std::runtime_error(std::string("Failed to serialize ") +
-                typeid(PB_T).name());
-    }
-    auto key_filter = [sign](gpgme_key_t k)->bool {
-        return !k->revoked && !k->expired && k->can_encrypt &&
-            (sign ? k->can_sign : true);
-    };
-    ctx.encrypt(ctx.get_keys(recipients, false, key_filter), dec_data, dest,
-            sign);
+    trace_span span{"encode_data"};
+    ctx.encrypt(encode_keys(ctx, recipients, sign),
+            serialize_deterministic(msg), dest, sign);
 }
 
 template <typename PB_T>
@@ -92,5 +132,75 @@ auto encode_data(gpgh::context &ctx,
     return encode_data(ctx, std::vector<std::string>{recipient}, msg, sign);
 }
 
+//=============================================================================
+// Encrypt/Decrypt a length delimited stream of messages
+// The stream is serialized as gpg consumes it, one message at a time.
+//=============================================================================
+
+// Encrypt to keys, as resolved and pin checked by recipient_keys
+template <typename PB_T>
+void encode_delimited(gpgh::context &ctx, const gpgh::keylist &keys,
+        std::function<std::optional<PB_T>(void)> next, std::ostream &dest,
+        bool sign=false)
+{
+    trace_span span{"encode_delimited"};
+    pwdb::generator_streambuf dec_sbuf{
+        [&next]()->std::optional<std::string> {
+            auto msg = next();
+            if(!msg)
+                return std::nullopt;
+            std::string frame;
+            google::protobuf::io::StringOutputStream frame_strm{&frame};
+            if(!google::protobuf::util::SerializeDelimitedToZeroCopyStream(
+                        *msg, &frame_strm)) {
+                throw std::runtime_error(std::string("Failed to serialize ") +
+                        typeid(PB_T).name());
+            }
+            return frame;
+        }
+    };
+    std::istream dec_data{&dec_sbuf};
+    ctx.encrypt(keys, dec_data, dest, sign);
+}
+
+// Parse the length delimited messages of dec_data, calling fn with each.
+// ArrayInputStream sizes are int, so dec_data is read as a chain of slices
+// of at most max_slice bytes.
+template <typename PB_T>
+void parse_delimited(std::string_view dec_data,
+        std::function<void(PB_T &&)> fn, std::size_t max_slice = INT_MAX)
+{
+    max_slice = std::clamp<std::size_t>(max_slice, 1, INT_MAX);
+    std::deque<google::protobuf::io::ArrayInputStream> slices;
+    std::vector<google::protobuf::io::ZeroCopyInputStream *> slice_ptrs;
+    for(std::size_t pos = 0; pos < dec_data.size(); pos += max_slice) {
+        slices.emplace_back(dec_data.data() + pos, static_cast<int>(
+                    std::min(max_slice, dec_data.size() - pos)));
+        slice_ptrs.push_back(&slices.back());
+    }
+    google::protobuf::io::ConcatenatingInputStream dec_strm{
+        slice_ptrs.data(), static_cast<int>(slice_ptrs.size())};
+    while(true) {
+        PB_T msg;
+        bool clean_eof = false;
+        if(!google::protobuf::util::ParseDelimitedFromZeroCopyStream(&msg,
+                    &dec_strm, &clean_eof)) {
+            if(clean_eof)
+                break;
+            throw std::runtime_error(std::string("Failed to parse ") +
+                    typeid(PB_T).name());
+        }
+        fn(std::move(msg));
+    }
+}
+
+template <typename PB_T>
+void decode_delimited(gpgh::context &ctx, std::istream &src,
+        std::function<void(PB_T &&)> fn)
+{
+    trace_span span{"decode_delimited"};
+    parse_delimited<PB_T>(ctx.decrypt(src), std::move(fn));
+}
+
 } // namespace pwdb
 #endif //  pwdb_pb_gph_h_included
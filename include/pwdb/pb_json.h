@@ -22,8 +22,11 @@
 
 ***/
 
+#include "pwdb/pb_json_codec.h"
 #include <stdexcept>
 #include <string>
+#include <istream>
+#include <sstream>
 #include <google/protobuf/util/json_util.h>
 
 namespace pwdb {
@@ -35,12 +38,17 @@ namespace pwdb {
 template <typename PB_T>
 auto json2pb(const std::string &json)->PB_T
 {
-    google::protobuf::util::JsonParseOptions jopts;
-    jopts.ignore_unknown_fields = false;
     PB_T msg;
-    auto stat = google::protobuf::util::JsonStringToMessage(json, &msg, jopts);
-    if(!stat.ok())
-        throw std::runtime_error(std::string(stat.message()));
+    if constexpr(json_codec::has_codec<PB_T>) {
+        json_codec::parse(json, msg);
+    } else {
+        google::protobuf::util::JsonParseOptions jopts;
+        jopts.ignore_unknown_fields = false;
+        auto stat = google::protobuf::util::JsonStringToMessage(json, &msg,
+                jopts);
+        if(!stat.ok())
+            throw std::runtime_error(std::string(stat.message()));
+    }
     return msg;
 }
 
@@ -57,5 +65,76 @@ auto pb2json(const PB_T &msg)->std::string
     return json;
 }
 
+//=============================================================================
+// Newline Delimited JSON (NDJSON) Conversion
+// Each line is a compact JSON object holding a partial message. Lines are
+// merged in order, so a large message can be written and read piecewise.
+//=============================================================================
+
+template <typename PB_T>
+auto pb2json_line(const PB_T &msg)->std::string
+{
+    std::string json;
+    if constexpr(json_codec::has_codec<PB_T>) {
+        json_codec::write(json, msg);
+    } else {
+        google::protobuf::util::JsonPrintOptions jopts;
+        jopts.preserve_proto_field_names = true;
+        jopts.add_whitespace = false;
+        auto stat = google::protobuf::util::MessageToJsonString(msg, &json,
+                jopts);
+        if(!stat.ok())
+            throw std::runtime_error(std::string(stat.message()));
+    }
+    json.push_back('\n');
+    return json;
+}
+
+template <typename PB_T>
+auto ndjson2pb(std::istream &in)->PB_T
+{
+    PB_T msg;
+    std::string line;
+    while(std::getline(in, line)) {
+        if(line.empty())
+            continue;
+        msg.MergeFrom(json2pb<PB_T>(line));
+    }
+    return msg;
+}
+
+template <typename PB_T>
+auto ndjson2pb(const std::string &json)->PB_T
+{
+    std::istringstream in{json};
+    return ndjson2pb<PB_T>(in);
+}
+
+// True if the first line of json is a complete JSON object, as opposed to the
+// opening of a multi-line document such as written by pb2json().
+inline bool is_ndjson(const std::string &json)
+{
+    int depth = 0;
+    bool in_str = false;
+    for(auto i = json.begin(); i != json.end() && *i != '\n'; ++i) {
+        if(in_str) {
+            if(*i == '\\')
+                ++i;
+            else if(*i == '"')
+                in_str = false;
+            if(i == json.end())
+                break;
+        } else if(*i == '"') {
+            in_str = true;
+        } else if(*i == '{' || *i == '[') {
+            ++depth;
+        } else if(*i == '}' || *i == ']') {
+            if(--depth == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
 } // namespace pwdb
 #endif //  pwdb_pb_json_h_included
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_pb_json_codec_h_included
+#define pwdb_pb_json_codec_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/pwdb.pb.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+namespace pwdb::json_codec {
+
+//=============================================================================
+// Specialized JSON codec for the pwdb protobuf messages
+// Produces and accepts the same JSON as the protobuf reflection based
+// conversion with preserve_proto_field_names, without the reflection. Parsing
+// is two staged: a SIMD scan indexes the structural characters outside of
+// strings, then a schema driven parser walks the index.
+//=============================================================================
+
+template <typename PB_T>
+constexpr bool has_codec = std::is_same_v<PB_T, pb::DB> ||
+    std::is_same_v<PB_T, pb::Record> || std::is_same_v<PB_T, pb::Store>;
+
+// Serialize compact JSON, appending to out. Map entries are sorted by key.
+void write(std::string &out, const pb::Store &store);
+void write(std::string &out, const pb::Record &rcd);
+void write(std::string &out, const pb::DB &pb_db);
+
+// Parse JSON into msg, which is cleared first. Throws std::runtime_error.
+void parse(std::string_view json, pb::Store &store);
+void parse(std::string_view json, pb::Record &rcd);
+void parse(std::string_view json, pb::DB &pb_db);
+
+// Append s to out as a quoted and escaped JSON string
+void write_string(std::string &out, std::string_view s);
+
+// Stage one: offsets of the structural characters {}[]:, outside of strings
+// and of both quotes of every string. Exposed for testing.
+auto structural_index(std::string_view json)->std::vector<uint32_t>;
+
+} // namespace pwdb::json_codec
+#endif //  pwdb_pb_json_codec_h_included
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_prefetch_h_included
+#define pwdb_prefetch_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/store_cache.h"
+#include "gpgh/gpg_async.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pwdb {
+
+//=============================================================================
+// Background decryption of record stores into a store_cache
+// For records just shown to the user, one of which is likely to be opened
+// next. A worker thread runs up to max_in_flight decryptions at once on a
+// gpgh::event_loop, so the record opened is usually cached by the time it is.
+//=============================================================================
+class prefetcher
+{
+public:
+    static constexpr size_t max_in_flight = 4;
+
+    struct job
+    {
+        std::string name;
+        std::string data;   // ciphertext of the store
+    };
+
+    explicit prefetcher(store_cache &cache, std::string gpg_homedir = {}) :
+        cache_{cache}, gpg_homedir_{std::move(gpg_homedir)} { ; }
+    prefetcher(const prefetcher&) = delete;
+    prefetcher &operator=(const prefetcher&) = delete;
+    ~prefetcher();
+
+    // Decrypt the stores of jobs into the cache, in order, replacing any jobs
+    // not yet started
+    void start(std::vector<job> jobs);
+    // Drop the jobs not yet started, except that of record keep. Decryptions
+    // under way are left to finish.
+    void cancel(const std::string &keep = {});
+    // Wait until no job for record name is queued or under way
+    void wait(const std::string &name);
+
+private:
+    store_cache &cache_;
+    const std::string gpg_homedir_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<job> queue_;
+    std::multiset<std::string> busy_;
+    bool stop_{false};
+    std::thread thread_;
+
+    void work(void);
+    auto fetch(gpgh::event_loop &loop)->gpgh::task<void>;
+};
+
+} // namespace pwdb
+#endif // pwdb_prefetch_h_included
@@ -24,48 +24,76 @@
 
 #include "cmd_interp/cmd_interp.h"
 #include "pwdb/db.h"
+#include "pwdb/output_format.h"
+#include "pwdb/store_cache.h"
+#include "pwdb/prefetch.h"
+#include <memory>
 
 namespace pwdb {
 
 class pwdb_cmd_interp
 {
     bool modified_{false};
+    bool read_only_{false};
+    output_format format_{output_format::text};
     pwdb::db &cdb_;
+    pwdb::store_cache cache_;
+    std::unique_ptr<pwdb::prefetcher> prefetch_;
     cmd_interp::interp interp_;
 
     auto def_interp(const cmd_interp::ops &ops)->cmd_interp::interp;
+    void list_records(std::vector<std::string> names);
 public:
     pwdb_cmd_interp(void) = delete;
     pwdb_cmd_interp(const pwdb_cmd_interp&) = delete;
     pwdb_cmd_interp(pwdb_cmd_interp&&) = default;
-    pwdb_cmd_interp(pwdb::db &cdb, const cmd_interp::ops &ops);
-    pwdb_cmd_interp(pwdb::db &cdb) :
-        pwdb_cmd_interp(cdb, cmd_interp::readline_ops()) { ; }
+    pwdb_cmd_interp(pwdb::db &cdb, const cmd_interp::ops &ops,
+            bool read_only = false);
+    pwdb_cmd_interp(pwdb::db &cdb, bool read_only = false) :
+        pwdb_cmd_interp(cdb, cmd_interp::readline_ops(), read_only) { ; }
     auto operator=(const pwdb_cmd_interp&)->pwdb_cmd_interp& = delete;
     auto operator=(pwdb_cmd_interp&&)->pwdb_cmd_interp& = default;
 
     void run(std::string prompt) { interp_.run(prompt); }
     bool modified(void) const { return modified_; }
+    bool read_only(void) const { return read_only_; }
+    // Decrypt the records shown by list and find in the background, when
+    // there are at most prefetch_max of them
+    static constexpr size_t prefetch_max = 8;
+    void prefetch(bool enable);
+    // Format of what list, find, tags, dump and print show
+    void format(output_format fmt) { format_ = fmt; }
 };
 
 class rcd_cmd_interp
 {
     bool modified_{false};
+    bool read_only_{false};
+    output_format format_{output_format::text};
     pwdb::pb::Store store_;
     cmd_interp::interp interp_;
 
     auto def_interp(const cmd_interp::ops &ops)->cmd_interp::interp;
+    // Print key/value pairs in the output format
     template<typename InputIt>
-    static void print_columns(InputIt begin, InputIt end) {
-        cmd_interp::print_columns(std::cout, begin, end, " : ", "  ");
+    void print_rows(InputIt begin, InputIt end) const {
+        if(format_ == output_format::text) {
+            cmd_interp::print_columns(std::cout, begin, end, " : ", "  ");
+            return;
+        }
+        cmd_interp::output out;
+        row_writer rows{out.buffer(), format_, {"key", "value"}};
+        for(; begin != end; ++begin)
+            rows.row({(*begin)[0], (*begin)[1]});
     }
 public:
     rcd_cmd_interp(void) = delete;
     rcd_cmd_interp(const rcd_cmd_interp&) = delete;
     rcd_cmd_interp(rcd_cmd_interp&&) = default;
-    rcd_cmd_interp(const pwdb::pb::Store &store, const cmd_interp::ops &ops);
-    rcd_cmd_interp(const pwdb::pb::Store &store) :
-        rcd_cmd_interp(store, cmd_interp::readline_ops()) { ; }
+    rcd_cmd_interp(const pwdb::pb::Store &store, const cmd_interp::ops &ops,
+            bool read_only = false);
+    rcd_cmd_interp(const pwdb::pb::Store &store, bool read_only = false) :
+        rcd_cmd_interp(store, cmd_interp::readline_ops(), read_only) { ; }
     auto operator=(const rcd_cmd_interp&)->rcd_cmd_interp& = delete;
     auto operator=(rcd_cmd_interp&&)->rcd_cmd_interp& = default;
 
@@ -74,6 +102,7 @@ public:
         { return interp_.handle(cmdline); };
     auto store(void) const->const pwdb::pb::Store & { return store_; }
     bool modified(void) const { return modified_; }
+    void format(output_format fmt) { format_ = fmt; }
     void print(void) const;
 };
 
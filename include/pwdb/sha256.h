@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_sha256_h_included
+#define pwdb_sha256_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+namespace pwdb {
+
+//-----------------------------------------------------------------------------
+class sha256
+// Incremental SHA-256 (FIPS 180-4), for content hashes of records. These are
+// compared, never trusted for authenticity; the signature on the outer DB
+// covers that.
+//-----------------------------------------------------------------------------
+{
+public:
+    using digest = std::array<uint8_t, 32>;
+
+    sha256(void) { reset(); }
+    void reset(void);
+    sha256 &update(const void *data, size_t len);
+    sha256 &update(std::string_view s) { return update(s.data(), s.size()); }
+    // Length prefixed, so that a sequence of fields hashes unambiguously
+    sha256 &update_field(std::string_view s);
+    // Digest of all data since reset, then reset
+    auto finish(void)->digest;
+
+    static auto hash(std::string_view s)->digest
+        { return sha256{}.update(s).finish(); }
+private:
+    void compress(const uint8_t *block);
+
+    std::array<uint32_t, 8> state_;
+    std::array<uint8_t, 64> buf_;
+    size_t buf_len_;
+    uint64_t total_len_;
+};
+
+//-----------------------------------------------------------------------------
+class hmac_sha256
+// HMAC-SHA-256 (RFC 2104), for digests of plaintext that must not be open to
+// checking guesses by anyone without the key
+//-----------------------------------------------------------------------------
+{
+public:
+    explicit hmac_sha256(std::string_view key);
+    hmac_sha256 &update(std::string_view s) { inner_.update(s); return *this; }
+    hmac_sha256 &update_field(std::string_view s)
+        { inner_.update_field(s); return *this; }
+    // Digest of all data since construction; call once
+    auto finish(void)->sha256::digest;
+private:
+    sha256 inner_;
+    std::array<uint8_t, 64> outer_key_;
+};
+
+auto to_hex(const sha256::digest &d)->std::string;
+
+} // namespace pwdb
+#endif // pwdb_sha256_h_included
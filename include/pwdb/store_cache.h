@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_store_cache_h_included
+#define pwdb_store_cache_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/pwdb.pb.h"
+#include "pwdb/sha256.h"
+#include "pwdb/util.h"
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pwdb {
+
+//=============================================================================
+// Session cache of decrypted record stores
+// Entries are keyed by record name and the hash of the ciphertext they were
+// decrypted from, so an entry never outlives the ciphertext it stands for.
+// Stores are kept serialized in locked_buffers, zeroized on eviction. The
+// least recently used are evicted beyond max_bytes, and any is dropped ttl
+// after it was decrypted. Safe to use from several threads.
+//=============================================================================
+class store_cache
+{
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr size_t default_max_bytes = 1024 * 1024;
+    static constexpr std::chrono::seconds default_ttl{300};
+
+    struct stats_t
+    {
+        size_t hits{0};
+        size_t misses{0};
+        size_t evictions{0};    // dropped for space
+        size_t expirations{0};  // dropped for age
+        size_t entries{0};
+        size_t bytes{0};
+        size_t unlocked{0};     // entries mlock failed for
+    };
+
+    explicit store_cache(size_t max_bytes = default_max_bytes,
+            clock::duration ttl = default_ttl) :
+        max_bytes_{max_bytes}, ttl_{ttl} { ; }
+    store_cache(const store_cache&) = delete;
+    store_cache &operator=(const store_cache&) = delete;
+
+    // Store of record name if cached for ciphertext data, also setting
+    // keyids, if given, to the IDs of the keys data was encrypted to
+    auto find(const std::string &name, const std::string &data,
+            std::vector<std::string> *keyids = nullptr)->
+        std::optional<pb::Store>;
+    // Whether find would hit, without counting as a hit or miss
+    bool contains(const std::string &name, const std::string &data) const;
+    void insert(const std::string &name, const std::string &data,
+            const pb::Store &store, std::vector<std::string> keyids = {});
+    // Drop the entry of record name, as when its store is saved
+    void erase(const std::string &name);
+    void clear(void);
+    // Drop entries older than ttl
+    void expire(void);
+    auto stats(void) const->stats_t;
+
+private:
+    struct entry
+    {
+        std::string name;
+        sha256::digest data_hash;
+        locked_buffer store;
+        std::vector<std::string> keyids;
+        clock::time_point expires;
+    };
+    using lru_list = std::list<entry>;
+
+    const size_t max_bytes_;
+    const clock::duration ttl_;
+    mutable std::mutex mutex_;
+    lru_list lru_;  // most recently used first
+    std::unordered_map<std::string, lru_list::iterator> index_;
+    stats_t stats_;
+
+    void drop(lru_list::iterator i);
+    void expire_locked(clock::time_point now);
+};
+
+} // namespace pwdb
+#endif // pwdb_store_cache_h_included
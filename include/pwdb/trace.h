@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef pwdb_trace_h_included
+#define pwdb_trace_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace pwdb {
+
+//=============================================================================
+// Tracing of hot paths
+// With PWDB_TRACE set to a file name, the spans timed by trace_span while a
+// trace_session lasts are written there as Chrome trace-event JSON, to view
+// in Perfetto or chrome://tracing. Without it a span costs an atomic load.
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+class trace_session
+// Records spans from any thread while it lasts if PWDB_TRACE is set, writing
+// them out when destroyed. There is one, in main.
+//-----------------------------------------------------------------------------
+{
+    static inline std::atomic<bool> active_{false};
+    const std::string file_;
+public:
+    trace_session(void);
+    trace_session(const trace_session&) = delete;
+    trace_session &operator=(const trace_session&) = delete;
+    ~trace_session();
+
+    // Whether spans are being recorded
+    static bool active(void) noexcept
+        { return active_.load(std::memory_order_relaxed); }
+};
+
+//-----------------------------------------------------------------------------
+class trace_span
+// A span of the trace, from construction until destruction. name must last
+// as long as the program, as string literals do. detail, such as a file
+// name, is shown with the span and only copied when tracing. Record names and
+// other vault contents must not be given as detail.
+//-----------------------------------------------------------------------------
+{
+    const char *name_{nullptr};
+    std::string detail_;
+    std::chrono::steady_clock::time_point start_{};
+
+    void end(void) noexcept;
+public:
+    explicit trace_span(const char *name, std::string_view detail = {})
+    {
+        if(!trace_session::active())
+            return;
+        name_ = name;
+        detail_ = detail;
+        start_ = std::chrono::steady_clock::now();
+    }
+    trace_span(const trace_span&) = delete;
+    trace_span &operator=(const trace_span&) = delete;
+    ~trace_span() { if(name_ != nullptr) end(); }
+};
+
+} // namespace pwdb
+#endif // pwdb_trace_h_included
@@ -23,14 +23,41 @@
 ***/
 
 #include <string>
+#include <string_view>
 #include <ostream>
+#include <streambuf>
+#include <optional>
 #include <functional>
 #include <filesystem>
+#include <chrono>
+#include <cstdint>
+
+extern "C" {
+#include <signal.h>
+}
 
 namespace pwdb {
 
 auto xdg_data_dir(void)->std::string;
 
+//-----------------------------------------------------------------------------
+struct file_generation
+// Identifies one version of a file. Writers replace the file by rename (see
+// lock_overwrite_file) so any new version has a new inode, and a differing
+// generation means the file changed.
+//-----------------------------------------------------------------------------
+{
+    bool exists{false};
+    uint64_t dev{0};
+    uint64_t ino{0};
+    uint64_t size{0};
+    int64_t mtime_ns{0};
+
+    bool operator==(const file_generation&) const = default;
+};
+
+auto get_file_generation(const std::filesystem::path &file)->file_generation;
+
 //-----------------------------------------------------------------------------
 class lock_overwrite_file
 // Scope-guard class to safely handle modifying a file by read, modify in-memory
@@ -49,6 +76,9 @@ public:
 
     lock_overwrite_file(void) = default;
     lock_overwrite_file(const std::filesystem::path &file);
+    // Retry while the file is in use, for up to wait
+    lock_overwrite_file(const std::filesystem::path &file,
+            std::chrono::milliseconds wait);
     lock_overwrite_file(const lock_overwrite_file&) = delete;
     lock_overwrite_file(lock_overwrite_file &&other) noexcept;
     lock_overwrite_file &operator=(const lock_overwrite_file&) = delete;
@@ -60,9 +90,101 @@ public:
     auto tmp_file(void) const noexcept -> const std::filesystem::path&
         { return tmp_file_; }
     void overwrite(std::function<void(std::ostream&)> writer);
+    // Replace the file as overwrite does, but keep the lock so the file may be
+    // replaced again, to save progress of long running work
+    void checkpoint(std::function<void(std::ostream&)> writer);
     friend void swap(lock_overwrite_file&, lock_overwrite_file&) noexcept;
 };
 
+//-----------------------------------------------------------------------------
+class file_watch
+// Watch a file for being rewritten or replaced, using inotify. The parent
+// directory is watched since replacing by rename (see lock_overwrite_file)
+// gives the file a new inode, which would end a watch on the file itself.
+//-----------------------------------------------------------------------------
+{
+    int fd_{-1};
+    std::string name_;
+public:
+    file_watch(const std::filesystem::path &file);
+    file_watch(const file_watch&) = delete;
+    file_watch &operator=(const file_watch&) = delete;
+    ~file_watch();
+
+    // Wait up to timeout for changes, returns true if the file changed
+    bool wait(std::chrono::milliseconds timeout);
+};
+
+//-----------------------------------------------------------------------------
+class generator_streambuf : public std::streambuf
+// Input streambuf whose content is produced on demand, one chunk at a time, by
+// a generator function returning an empty optional at end of stream. Only the
+// current chunk is held in memory, so a consumer such as a gpg encryption can
+// start writing output before the generator has produced everything.
+//-----------------------------------------------------------------------------
+{
+public:
+    using generator_t = std::function<std::optional<std::string>(void)>;
+
+    generator_streambuf(generator_t gen) : gen_{std::move(gen)} { ; }
+    generator_streambuf(const generator_streambuf&) = delete;
+    generator_streambuf &operator=(const generator_streambuf&) = delete;
+protected:
+    int_type underflow(void) override;
+private:
+    generator_t gen_;
+    std::string buf_;
+};
+
+//----------------------------------------------------------------------------
+class interrupt_guard
+// Scope-guard class to catch SIGINT, so long running work can stop cleanly at
+// a point of its choosing. Only one may exist at a time.
+//----------------------------------------------------------------------------
+{
+public:
+    interrupt_guard(void);
+    interrupt_guard(const interrupt_guard &) = delete;
+    interrupt_guard &operator=(const interrupt_guard &) = delete;
+    ~interrupt_guard();
+
+    bool interrupted(void) const;
+private:
+    struct sigaction old_action_;
+};
+
+//----------------------------------------------------------------------------
+class locked_buffer
+// Copy of sensitive bytes in memory locked against being swapped out, where
+// possible, and zeroized when freed. The bytes are mapped in whole pages of
+// their own, so no other buffer shares their lock.
+//----------------------------------------------------------------------------
+{
+public:
+    locked_buffer(void) = default;
+    explicit locked_buffer(std::string_view bytes);
+    locked_buffer(locked_buffer &&other) noexcept;
+    locked_buffer &operator=(locked_buffer &&other) noexcept;
+    locked_buffer(const locked_buffer &) = delete;
+    locked_buffer &operator=(const locked_buffer &) = delete;
+    ~locked_buffer();
+
+    auto view(void) const noexcept->std::string_view { return {data_, size_}; }
+    auto size(void) const noexcept->size_t { return size_; }
+    // Whether mlock succeeded, it may not over RLIMIT_MEMLOCK
+    bool locked(void) const noexcept { return locked_; }
+private:
+    char *data_{nullptr};
+    size_t size_{0};
+    size_t mapped_{0};
+    bool locked_{false};
+
+    void release(void) noexcept;
+};
+
+// Overwrite s with zeros, in a way the compiler may not elide
+void zeroize(std::string &s) noexcept;
+
 //----------------------------------------------------------------------------
 class term_mode
 // Scope-guard class to set terminal to use the alt buffer
@@ -23,9 +23,19 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <climits>
+#include <memory>
+#include <system_error>
 extern "C" {
 #include <readline/readline.h>
 #include <readline/history.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 } // extern "C"
 
 namespace cmd_interp {
@@ -36,37 +46,274 @@ split_args(const std::string &cmdline)
     return boost::program_options::split_unix(cmdline);
 }
 
+//----------------------------------------------------------------------------
+// Sources of events serviced while waiting for input
+//----------------------------------------------------------------------------
+namespace {
+
+class event_sources
+{
+    using clock = std::chrono::steady_clock;
+    struct fd_source
+    {
+        int fd;
+        ops::handler fn;
+    };
+    struct timer_source
+    {
+        clock::duration period;
+        clock::time_point due;
+        ops::handler fn;
+    };
+
+    ops::source_id next_id_{1};
+    std::map<ops::source_id, fd_source> fds_;
+    std::map<ops::source_id, timer_source> timers_;
+
+    auto poll_timeout(void) const->int;
+public:
+    auto add_fd(int fd, ops::handler fn)->ops::source_id
+    {
+        fds_.emplace(next_id_, fd_source{fd, std::move(fn)});
+        return next_id_++;
+    }
+    auto add_timer(std::chrono::milliseconds period, ops::handler fn)->
+        ops::source_id
+    {
+        timers_.emplace(next_id_, timer_source{period, clock::now() + period,
+                std::move(fn)});
+        return next_id_++;
+    }
+    void remove(ops::source_id id)
+    {
+        fds_.erase(id);
+        timers_.erase(id);
+    }
+    // Wait until fd is readable, calling the handlers of sources ready
+    // meanwhile
+    void wait(int fd);
+};
+
+int event_sources::
+poll_timeout(void) const
+{
+    if(timers_.empty())
+        return -1;
+    auto due = std::min_element(timers_.begin(), timers_.end(),
+        [](const auto &l, const auto &r) {
+            return l.second.due < r.second.due;
+        })->second.due;
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(
+            due - clock::now()).count();
+    return static_cast<int>(std::clamp<decltype(left)>(left, 0, INT_MAX));
+}
+
+void event_sources::
+wait(int fd)
+{
+    while(true) {
+        std::vector<pollfd> pfds{{fd, POLLIN, 0}};
+        std::vector<ops::source_id> ids;
+        for(const auto &[id, src]: fds_) {
+            pfds.push_back({src.fd, POLLIN, 0});
+            ids.push_back(id);
+        }
+        if(::poll(pfds.data(), pfds.size(), poll_timeout()) < 0) {
+            if(errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::system_category(), "poll");
+        }
+        // Handlers may add or remove sources, so each is looked up again, and
+        // called through a copy in case it removes itself
+        for(size_t i = 0; i != ids.size(); ++i) {
+            if(pfds[i + 1].revents == 0)
+                continue;
+            if(auto src = fds_.find(ids[i]); src != fds_.end()) {
+                auto fn = src->second.fn;
+                fn();
+            }
+        }
+        auto now = clock::now();
+        ids.clear();
+        for(const auto &[id, src]: timers_) {
+            if(src.due <= now)
+                ids.push_back(id);
+        }
+        for(auto id: ids) {
+            if(auto src = timers_.find(id); src != timers_.end()) {
+                src->second.due = now + src->second.period;
+                auto fn = src->second.fn;
+                fn();
+            }
+        }
+        if(pfds[0].revents != 0)
+            return;
+    }
+}
+
+} // namespace
+
 //----------------------------------------------------------------------------
 // GNU Readline support
 //----------------------------------------------------------------------------
+namespace {
+
+// State of the line being read through the readline callback interface, which
+// passes no user data to the line handler
+struct {
+    bool reading{false};
+    bool done{false};
+    char *line{nullptr};
+} rl_input;
+
+void
+rl_line_handler(char *lp)
+{
+    rl_input.done = true;
+    rl_input.line = lp;
+    // Removed here, or readline would show the prompt again on returning
+    rl_callback_handler_remove();
+}
+
+// Interpreters running, innermost last, the last completing what is typed
+std::vector<const interp*> running_interps;
+
+// Readline's matches for text, the first being their common prefix
+char **
+rl_complete_args(const char *text, int start, int)
+{
+    // Never fall back to completing file names
+    rl_attempted_completion_over = 1;
+    if(running_interps.empty())
+        return nullptr;
+    // Called back from C, so nothing may throw
+    try {
+        auto args = split_args(std::string(rl_line_buffer, start));
+        auto cands = running_interps.back()->complete(args, text);
+        if(cands.empty())
+            return nullptr;
+        auto common = cands.front().size();
+        for(const auto &c: cands) {
+            common = std::mismatch(c.begin(), c.begin() + std::min(common,
+                        c.size()), cands.front().begin()).first - c.begin();
+        }
+        auto n = cands.size() == 1 ? 1 : cands.size() + 1;
+        auto matches = static_cast<char**>(calloc(n + 1, sizeof(char*)));
+        if(matches == nullptr)
+            return nullptr;
+        matches[0] = strndup(cands.front().c_str(), common);
+        for(size_t i = 1; i < n; ++i)
+            matches[i] = strdup(cands[i - 1].c_str());
+        for(size_t i = 0; i != n; ++i) {
+            if(matches[i] == nullptr) {
+                for(size_t j = 0; j != n; ++j)
+                    free(matches[j]);
+                free(matches);
+                return nullptr;
+            }
+        }
+        return matches;
+    } catch(...) {
+        // e.g. an unterminated quote
+        return nullptr;
+    }
+}
+
+// Ends reading a line, restoring the terminal if a handler threw part way
+struct rl_read_guard
+{
+    rl_read_guard(const std::string &prompt)
+    {
+        rl_input = {.reading = true};
+        rl_callback_handler_install(prompt.c_str(), rl_line_handler);
+    }
+    rl_read_guard(const rl_read_guard&) = delete;
+    rl_read_guard &operator=(const rl_read_guard&) = delete;
+    ~rl_read_guard()
+    {
+        if(!rl_input.done)
+            rl_callback_handler_remove();
+        free(rl_input.line);
+        rl_input = {};
+    }
+};
+
+} // namespace
+
 ops
 readline_ops(void)
 {
+    auto sources = std::make_shared<event_sources>();
+    rl_attempted_completion_function = rl_complete_args;
+    // Break words only at whitespace, as split_args does
+    static char word_breaks[] = " \t\n";
+    rl_completer_word_break_characters = word_breaks;
     return ops {
         [](const std::string &line)->void {
             ::add_history(line.c_str());
         },
-        [](const std::string &prompt)->std::optional<std::string> {
-            std::optional<std::string> cmd{};
-            if(char *lp = readline(prompt.c_str()); lp != nullptr) {
-                cmd = lp;
-                free(lp);
+        [sources](const std::string &prompt)->std::optional<std::string> {
+            rl_read_guard guard{prompt};
+            while(!rl_input.done) {
+                sources->wait(fileno(rl_instream));
+                rl_callback_read_char();
             }
+            std::optional<std::string> cmd{};
+            if(rl_input.line != nullptr)
+                cmd = rl_input.line;
             return cmd;
-        }
+        },
+        [sources](int fd, ops::handler fn) {
+            return sources->add_fd(fd, std::move(fn));
+        },
+        [sources](std::chrono::milliseconds period, ops::handler fn) {
+            return sources->add_timer(period, std::move(fn));
+        },
+        [sources](ops::source_id id) { sources->remove(id); }
     };
 }
 
+void
+print_above_input(const std::function<void(void)> &fn)
+{
+    if(!rl_input.reading || rl_input.done) {
+        fn();
+        return;
+    }
+    struct restore_line
+    {
+        int point{rl_point};
+        std::unique_ptr<char, decltype(&free)> text{rl_copy_text(0, rl_end),
+            free};
+        restore_line(void)
+        {
+            rl_save_prompt();
+            rl_replace_line("", 0);
+            rl_redisplay();
+        }
+        ~restore_line()
+        {
+            rl_restore_prompt();
+            rl_replace_line(text ? text.get() : "", 0);
+            rl_point = point;
+            rl_redisplay();
+        }
+    } restore;
+    fn();
+}
+
 //----------------------------------------------------------------------------
 // std::getline command line source support
 //----------------------------------------------------------------------------
 ops
-istream_ops(std::istream &in)
+istream_ops(std::istream &in, bool show_prompt)
 {
     return ops{
         [](const std::string&) { ; },
-        [&in](const std::string &prompt)->std::optional<std::string> {
-            std::cout << prompt << std::flush;
+        [&in, show_prompt](const std::string &prompt)->
+            std::optional<std::string> {
+            if(show_prompt)
+                std::cout << prompt << std::flush;
             std::string line;
             return std::getline(in, line).good() ? line :
                 std::optional<std::string>{};
@@ -84,8 +331,27 @@ handle(const std::string &cmdline) const
     auto args = cmd_interp::split_args(cmdline);
     if(args.empty())
         return true;
+    if(on_command_)
+        on_command_(args);
     auto cmd = args.front();
+    struct timing
+    {
+        const timer_t &fn;
+        const std::string &cmd;
+        const std::chrono::steady_clock::time_point start{
+            std::chrono::steady_clock::now()};
+        ~timing() {
+            if(!fn)
+                return;
+            try {
+                fn(cmd, std::chrono::steady_clock::now() - start);
+            } catch(...) {
+                // Timing is only reporting, it must not fail the command
+            }
+        }
+    };
     if(cmd == "help") {
+        timing timed{on_timed_, cmd};
         args.size() == 1 ? help(std::cout) : help(std::cout, args[1]);
         add_history(cmdline);
         return true;
@@ -97,6 +363,7 @@ handle(const std::string &cmdline) const
         add_history(cmdline);
         return true;
     }
+    timing timed{on_timed_, cmd};
     auto rv = cmd_def->second.handle(args);
     if((rv & result_add_history).any()) {
         add_history(cmdline);
@@ -107,6 +374,11 @@ handle(const std::string &cmdline) const
 void interp::
 run(const std::string &prompt) const
 {
+    struct running
+    {
+        running(const interp *i) { running_interps.push_back(i); }
+        ~running() { running_interps.pop_back(); }
+    } completing{this};
     while(true) {
         auto cmd = ops_.get(prompt);
         if(!cmd)
@@ -119,6 +391,29 @@ run(const std::string &prompt) const
     }
 }
 
+std::vector<std::string> interp::
+complete(const std::vector<std::string> &args, const std::string &word) const
+{
+    // help takes a command name, as the first word does
+    if(args.empty() || (args.size() == 1 && args.front() == "help")) {
+        std::vector<std::string> cands;
+        for(auto i = interp_.lower_bound(word);
+                i != interp_.end() && i->first.starts_with(word); ++i) {
+            cands.push_back(i->first);
+        }
+        const std::string help{"help"};
+        if(args.empty() && help.starts_with(word)) {
+            cands.insert(std::lower_bound(cands.begin(), cands.end(), help),
+                    help);
+        }
+        return cands;
+    }
+    auto cmd_def = interp_.find(args.front());
+    if(cmd_def == interp_.end() || !cmd_def->second.complete)
+        return {};
+    return cmd_def->second.complete(args, word);
+}
+
 void interp::
 help(std::ostream &out, const std::string &cmd) const
 {
@@ -139,4 +434,113 @@ help(std::ostream &out) const
     out << std::flush;
 }
 
+//----------------------------------------------------------------------------
+// class output
+//----------------------------------------------------------------------------
+
+output::
+~output()
+{
+    try {
+        flush();
+    } catch(...) {
+        // Nowhere left to report it
+    }
+}
+
+void output::
+flush(void)
+{
+    if(!buf_.empty()) {
+        if(paging_ && &out_ == &std::cout && isatty(STDIN_FILENO) &&
+                isatty(STDOUT_FILENO)) {
+            page();
+        } else {
+            out_.write(buf_.data(), buf_.size());
+        }
+        buf_.clear();
+    }
+    out_.flush();
+}
+
+namespace {
+
+// Scope-guard class to read the terminal a key at a time, without echo
+class tty_keys
+{
+    termios saved_{};
+    bool set_{false};
+public:
+    tty_keys(void)
+    {
+        if(tcgetattr(STDIN_FILENO, &saved_) != 0)
+            return;
+        auto raw = saved_;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        set_ = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+    tty_keys(const tty_keys&) = delete;
+    tty_keys &operator=(const tty_keys&) = delete;
+    ~tty_keys()
+    {
+        if(set_)
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved_);
+    }
+    // Next key, or 'q' at end of input
+    char get(void)
+    {
+        char c;
+        return read(STDIN_FILENO, &c, 1) == 1 ? c : 'q';
+    }
+};
+
+} // namespace
+
+void output::
+page(void)
+{
+    winsize ws{};
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_row < 2 ||
+            ws.ws_col == 0) {
+        out_.write(buf_.data(), buf_.size());
+        return;
+    }
+    // A row is left for the prompt
+    const size_t page_rows = ws.ws_row - 1u;
+    std::string_view rest{buf_};
+    // Write as many lines as fill rows of the terminal, long ones wrapping
+    auto write_rows = [this, &rest, &ws](size_t rows) {
+        size_t end = 0;
+        while(end != rest.size()) {
+            auto nl = rest.find('\n', end);
+            auto next = nl == rest.npos ? rest.size() : nl + 1;
+            auto used = std::max<size_t>(1, (next - end - 1 + ws.ws_col - 1) /
+                    ws.ws_col);
+            if(used > rows && end != 0)
+                break;
+            rows -= std::min(used, rows);
+            end = next;
+            if(rows == 0)
+                break;
+        }
+        out_.write(rest.data(), end);
+        rest.remove_prefix(end);
+    };
+    write_rows(page_rows);
+    if(rest.empty())
+        return;
+    tty_keys keys;
+    const std::string_view more{"--More-- (space, enter, q)"};
+    while(!rest.empty()) {
+        out_ << more << std::flush;
+        auto c = keys.get();
+        out_ << '\r' << std::string(more.size(), ' ') << '\r';
+        if(c == 'q' || c == 'Q')
+            break;
+        write_rows(c == '\n' || c == '\r' ? 1 : page_rows);
+    }
+}
+
 } // namespace cmd_interp
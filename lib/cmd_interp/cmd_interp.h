@@ -21,16 +21,22 @@
     along with this program. If not, see <https://www.gnu.org/licenses/>.
 ***/
 
+#include <chrono>
 #include <functional>
 #include <map>
 #include <vector>
 #include <string>
 #include <ostream>
+#include <iostream>
+#include <iterator>
+#include <format>
 #include <sstream>
 #include <iomanip>
 #include <optional>
 #include <bitset>
 #include <ranges>
+#include <algorithm>
+#include <string_view>
 
 namespace cmd_interp {
 
@@ -39,19 +45,36 @@ namespace cmd_interp {
 //-----------------------------------------------------------------------------
 struct ops
 {
+    using source_id = unsigned;
+    using handler = std::function<void(void)>;
     using add_history_proto = void(const std::string &line);
     using get_proto = auto(const std::string &prompt)->
         std::optional<std::string>;
+    using add_fd_proto = auto(int fd, handler fn)->source_id;
+    using add_timer_proto = auto(std::chrono::milliseconds period,
+            handler fn)->source_id;
+    using remove_source_proto = void(source_id id);
 
     std::function<add_history_proto> add_history;
     std::function<get_proto> get;
+    // Sources of events serviced while get waits for a line, unset where get
+    // cannot wait on them. fn is called whenever fd is readable, or every
+    // period. A source must be removed before its fd is closed.
+    std::function<add_fd_proto> add_fd;
+    std::function<add_timer_proto> add_timer;
+    std::function<remove_source_proto> remove_source;
 };
 
-// readline command line source support
+// readline command line source support, using the callback interface to
+// service the sources while waiting for input
 ops readline_ops(void);
 
-// std::getline command line source support
-ops istream_ops(std::istream &in);
+// std::getline command line source support, showing prompts if show_prompt
+ops istream_ops(std::istream &in, bool show_prompt = true);
+
+// Call fn, which writes to the terminal, from a source handler. The line being
+// read is cleared first and redrawn after, so fn must flush what it writes.
+void print_above_input(const std::function<void(void)> &fn);
 
 //-----------------------------------------------------------------------------
 // Command interpreter
@@ -63,14 +86,24 @@ public:
     static constexpr result_t result_exit = 1u << 0;
     static constexpr result_t result_add_history = 1u << 1;
 
+    // Candidates for word, an argument being typed after args
+    using completer_t = std::function<std::vector<std::string>(
+            const std::vector<std::string> &args, const std::string &word)>;
+
     struct cmd_def
     {
         std::string help;
         std::function<result_t(const std::vector<std::string> &)> handle;
+        completer_t complete{};
     };
+    using observer_t = std::function<void(const std::vector<std::string> &)>;
+    using timer_t = std::function<void(const std::string &cmd,
+            std::chrono::steady_clock::duration took)>;
 private:
     cmd_interp::ops ops_ = readline_ops();
     std::map<std::string, cmd_def> interp_;
+    observer_t on_command_;
+    timer_t on_timed_;
 public:
     interp(void) = default;
     interp(const cmd_interp::ops &ops) : ops_{ops} { ; }
@@ -82,6 +115,15 @@ public:
     auto ops(void)->const cmd_interp::ops& { return ops_; }
     void help(std::ostream &out, const std::string &cmd) const;
     void help(std::ostream &out) const;
+    // Call fn with the arguments of every command line before handling it
+    void on_command(observer_t fn) { on_command_ = std::move(fn); }
+    // Call fn with the time each known command took to handle, also when its
+    // handler threw
+    void on_timed(timer_t fn) { on_timed_ = std::move(fn); }
+    // Candidates for word, typed after args: command names for the first
+    // word, then those of the command's completer, in order
+    auto complete(const std::vector<std::string> &args,
+            const std::string &word) const->std::vector<std::string>;
 };
 
 //-----------------------------------------------------------------------------
@@ -103,9 +145,54 @@ auto assemble(const inputIter begin, const inputIter end)->std::string {
     return assemble(std::ranges::subrange(begin, end));
 }
 
+// Candidates among names, in order, that start with word
+template<typename R>
+auto complete_from(const R &names, const std::string &word)->
+    std::vector<std::string>
+{
+    std::vector<std::string> out;
+    for(const auto &name: names) {
+        if(std::string_view{name}.starts_with(word))
+            out.emplace_back(name);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+//-----------------------------------------------------------------------------
+// Buffered output
+//-----------------------------------------------------------------------------
+class output
+// Output of a command, formatted into memory and written out in one go when
+// done, rather than flushed line by line. Written to std::cout on a terminal,
+// with paging on, output longer than the terminal is shown a page at a time.
+{
+    std::ostream &out_;
+    std::string buf_;
+    static inline bool paging_{false};
+
+    void page(void);
+public:
+    explicit output(std::ostream &out = std::cout) : out_{out} { ; }
+    output(const output&) = delete;
+    output &operator=(const output&) = delete;
+    ~output();
+
+    template<typename... Args>
+    void print(std::format_string<Args...> fmt, Args&&... args) {
+        std::format_to(std::back_inserter(buf_), fmt,
+                std::forward<Args>(args)...);
+    }
+    // The buffer, to append to directly
+    auto buffer(void)->std::string& { return buf_; }
+    void flush(void);
+    static void paging(bool enable) { paging_ = enable; }
+};
+
+// Append rows of columns to buf, each column padded to its widest cell
 template<typename InputIterator>
-void print_columns(std::ostream &out, InputIterator first, InputIterator last,
-        std::string separator = " ", std::string prefix = "")
+void print_columns(std::string &buf, InputIterator first, InputIterator last,
+        std::string_view separator = " ", std::string_view prefix = "")
 {
     std::vector<size_t> widths;
     for(auto r=first; r!=last; ++r) {
@@ -118,15 +205,24 @@ void print_columns(std::ostream &out, InputIterator first, InputIterator last,
     }
     for(auto r=first; r!=last; ++r) {
         size_t c = 0;
-        out << prefix;
+        buf += prefix;
         for(auto ci = r->begin(); ci != r->end(); ++ci, ++c) {
             if(c != 0)
-                out << separator;
-            out << std::setw(widths[c]) << std::left << *ci;
+                buf += separator;
+            buf += *ci;
+            buf.append(widths[c] - ci->size(), ' ');
         }
-        out << std::endl;
+        buf += '\n';
     }
 }
 
+template<typename InputIterator>
+void print_columns(std::ostream &out, InputIterator first, InputIterator last,
+        std::string separator = " ", std::string prefix = "")
+{
+    output o{out};
+    print_columns(o.buffer(), first, last, separator, prefix);
+}
+
 } // namespace cmd_interp
 #endif // cmd_interp_cmd_interp_h_included
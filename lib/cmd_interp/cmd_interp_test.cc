@@ -21,6 +21,11 @@
 #include "cmd_interp/cmd_interp.h"
 #include <iostream>
 #include <sstream>
+#include <cstdio>
+extern "C" {
+#include <readline/readline.h>
+#include <unistd.h>
+} // extern "C"
 
 constexpr const char progname[] = "cmd_interp_test";
 
@@ -55,6 +60,18 @@ utils_test(void)
     ret |= tassert(assemble(vs{"foo"s, "bar"s, "baz"s}) == "foo bar baz"s,
             "assemble multi"s);
 
+    // print_columns()
+    {
+        std::vector<vs> rows{{"a"s, "bbb"s}, {"cc"s, "d"s}};
+        std::string buf;
+        print_columns(buf, rows.begin(), rows.end(), " : "s, "> "s);
+        ret |= tassert(buf == "> a  : bbb\n> cc : d  \n"s,
+                "print_columns buffer"s);
+        std::ostringstream out;
+        print_columns(out, rows.begin(), rows.end(), " : "s, "> "s);
+        ret |= tassert(out.str() == buf, "print_columns stream"s);
+    }
+
     return ret;
 }
 
@@ -112,6 +129,84 @@ interp_test(void)
     ret |= tassert(exit_res && (echo_res == "foo bar"s) &&
             (count_args_res == 4), "sequence"s);
 
+    std::vector<std::string> seen{};
+    interp.on_command([&seen](A &args) { seen.push_back(args.at(0)); });
+    interp.handle("echo foo"s);
+    interp.handle("no_such_command"s);
+    interp.handle(""s);
+    ret |= tassert(seen == std::vector<std::string>{"echo", "no_such_command"},
+            "on_command"s);
+
+    std::vector<std::string> timed{};
+    interp.on_timed([&timed](const std::string &cmd, auto took) {
+        if(took >= std::chrono::steady_clock::duration::zero())
+            timed.push_back(cmd);
+    });
+    interp.handle("echo foo"s);
+    interp.handle("no_such_command"s);
+    interp.handle("help"s);
+    ret |= tassert(timed == std::vector<std::string>{"echo", "help"},
+            "on_timed"s);
+
+    interp["echo"].complete = [](A &args, const std::string &word) {
+        return cmd_interp::complete_from(vs{"bar", "baz", "foo"}, word);
+    };
+    ret |= tassert(interp.complete({}, "e"s) == vs{"echo"s, "exit"s} &&
+            interp.complete({}, "h"s) == vs{"help"s} &&
+            interp.complete({"help"s}, "c"s) == vs{"count_args"s} &&
+            interp.complete({"echo"s}, "ba"s) == vs{"bar"s, "baz"s} &&
+            interp.complete({"count_args"s}, ""s).empty(), "complete"s);
+
+    return ret;
+}
+
+int
+readline_test(void)
+{
+    using A = const std::vector<std::string>;
+    using cmd_interp::interp;
+
+    // Input from a pipe, the sources writing it: a timer ticks three times
+    // then signals an event, whose handler types the command to exit
+    int input[2], event[2];
+    if(pipe(input) != 0 || pipe(event) != 0) {
+        std::cerr << "FAILED: pipe" << std::endl;
+        return 1;
+    }
+    rl_instream = fdopen(input[0], "r");
+    rl_outstream = fopen("/dev/null", "w");
+
+    auto ops = cmd_interp::readline_ops();
+    auto interp = cmd_interp::interp{ops};
+    bool exit_res = false;
+    interp["exit"] = { "Exit the interpreter",
+        [&exit_res](A &args)->interp::result_t {
+            exit_res = true;
+            return interp::result_exit;
+        }};
+
+    int ticks = 0;
+    cmd_interp::ops::source_id timer = 0;
+    timer = ops.add_timer(std::chrono::milliseconds{1}, [&]() {
+        if(++ticks == 3) {
+            ops.remove_source(timer);
+            (void)!write(event[1], "x", 1);
+        }
+    });
+    bool event_res = false;
+    ops.add_fd(event[0], [&]() {
+        char c;
+        (void)!read(event[0], &c, 1);
+        event_res = true;
+        std::string cmd{"exit\n"};
+        (void)!write(input[1], cmd.data(), cmd.size());
+    });
+    interp.run("> ");
+
+    bool ret = 0;
+    ret |= tassert(ticks == 3, "timer"s);
+    ret |= tassert(event_res, "fd"s);
+    ret |= tassert(exit_res, "exit"s);
     return ret;
 }
 
@@ -128,6 +223,8 @@ main(int argc, const char *argv[])
         return utils_test();
     if(test_name == "interp_test")
         return interp_test();
+    if(test_name == "readline_test")
+        return readline_test();
 
     std::cerr << progname << ": No such test: " << test_name << std::endl;
     return 1;
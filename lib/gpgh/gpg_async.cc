@@ -0,0 +1,361 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <https://www.gnu.org/licenses/>.
+***/
+
+#include "gpgh/gpg_async.h"
+#include <iterator>
+#include <sstream>
+#include <system_error>
+extern "C" {
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+} // extern "C"
+
+namespace gpgh {
+
+//=============================================================================
+// Operation state
+//=============================================================================
+
+// A file descriptor gpgme asked the loop to watch
+struct event_loop::io_watch
+{
+    op_state *op;
+    int fd;
+    gpgme_io_cb_t fnc;
+    void *fnc_data;
+    bool removed{false};
+    std::list<std::unique_ptr<io_watch>>::iterator pos{};
+};
+
+// A pooled context and the operation it runs, if any
+struct event_loop::op_state
+{
+    event_loop *loop;
+    gpgh::context ctx;
+    gpgme_io_cbs cbs{};
+    bool running{false};
+    gpgme_error_t err{GPG_ERR_NO_ERROR};
+    std::coroutine_handle<> waiter{};
+
+    op_state(event_loop *l, const std::string &gpg_homedir) :
+        loop{l}, ctx{gpg_homedir}
+    {
+        cbs.add = io_add;
+        cbs.add_priv = this;
+        cbs.remove = io_remove;
+        cbs.event = io_event;
+        cbs.event_priv = this;
+        gpgme_set_io_cbs(ctx.get(), &cbs);
+    }
+};
+
+// Exclusive use of a pooled context, returned to the pool when the lease ends.
+// An operation still running then is cancelled and its context dropped.
+class event_loop::op_lease
+{
+    event_loop *loop_;
+    std::unique_ptr<op_state> op_;
+public:
+    op_lease(event_loop *loop, std::unique_ptr<op_state> op) :
+        loop_{loop}, op_{std::move(op)} { ; }
+    op_lease(op_lease&&) = default;
+    op_lease(const op_lease&) = delete;
+    op_lease &operator=(const op_lease&) = delete;
+    ~op_lease()
+    {
+        if(!op_)
+            return;
+        if(op_->running) {
+            op_->waiter = {};
+            gerr_show(gpgme_cancel(op_->ctx.get()), "op_lease");
+            if(op_->running) {
+                // No done event, the operation is abandoned with the context
+                op_->running = false;
+                --loop_->in_flight_;
+            }
+            return;
+        }
+        loop_->idle_.push_back(std::move(op_));
+    }
+    auto operator->(void) const noexcept->op_state* { return op_.get(); }
+    auto operator*(void) const noexcept->op_state& { return *op_; }
+
+    // Check the result of a *_start call, the operation running if it is fine
+    void started(gpgme_error_t gerr, const char *pstr)
+    {
+        gerr_check(gerr, pstr);
+        op_->running = true;
+        ++loop_->in_flight_;
+    }
+};
+
+// Awaits the done event of an operation
+class event_loop::op_done
+{
+    op_state &op_;
+public:
+    explicit op_done(op_state &op) : op_{op} { ; }
+    bool await_ready(void) const noexcept { return !op_.running; }
+    void await_suspend(std::coroutine_handle<> h) noexcept { op_.waiter = h; }
+    void await_resume(void) const noexcept { ; }
+};
+
+//=============================================================================
+// gpgme user I/O callbacks
+// Called back from C, so none of these may throw
+//=============================================================================
+
+gpgme_error_t event_loop::
+io_add(void *data, int fd, int dir, gpgme_io_cb_t fnc, void *fnc_data,
+        void **tag)
+{
+    auto op = static_cast<op_state*>(data);
+    auto loop = op->loop;
+    try {
+        auto w = std::make_unique<io_watch>(op, fd, fnc, fnc_data);
+        epoll_event ev{};
+        // dir is 1 when gpgme reads from fd
+        ev.events = dir ? EPOLLIN : EPOLLOUT;
+        ev.data.ptr = w.get();
+        if(epoll_ctl(loop->epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+            return gpgme_error_from_syserror();
+        auto wp = w.get();
+        wp->pos = loop->watches_.insert(loop->watches_.end(), std::move(w));
+        *tag = wp;
+    } catch(...) {
+        errno = ENOMEM;
+        return gpgme_error_from_syserror();
+    }
+    return GPG_ERR_NO_ERROR;
+}
+
+void event_loop::
+io_remove(void *tag)
+{
+    auto w = static_cast<io_watch*>(tag);
+    auto loop = w->op->loop;
+    // fd may be closed already, which removes it from the epoll set anyway
+    (void)epoll_ctl(loop->epoll_fd_, EPOLL_CTL_DEL, w->fd, nullptr);
+    w->removed = true;
+    // A poll in progress may still hold w, so it is freed after the poll
+    try {
+        loop->removed_.push_back(std::move(*w->pos));
+        loop->watches_.erase(w->pos);
+    } catch(...) {
+        // Leave it among the watches, it is skipped being removed
+    }
+}
+
+void event_loop::
+io_event(void *data, gpgme_event_io_t type, void *type_data)
+{
+    if(type != GPGME_EVENT_DONE)
+        return;
+    auto op = static_cast<op_state*>(data);
+    auto done = static_cast<gpgme_io_event_done_data_t>(type_data);
+    if(op->err == GPG_ERR_NO_ERROR && done != nullptr)
+        op->err = done->err != GPG_ERR_NO_ERROR ? done->err : done->op_err;
+    if(op->running) {
+        op->running = false;
+        --op->loop->in_flight_;
+    }
+    if(op->waiter) {
+        try {
+            op->loop->ready_.push_back(std::exchange(op->waiter, {}));
+        } catch(...) {
+            std::terminate();
+        }
+    }
+}
+
+//=============================================================================
+// event_loop
+//=============================================================================
+
+event_loop::
+event_loop(const std::string &gpg_homedir) : gpg_homedir_{gpg_homedir}
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd_ < 0)
+        throw std::system_error(errno, std::system_category(), "epoll_create1");
+}
+
+event_loop::
+~event_loop()
+{
+    // Tasks first, as their leases cancel operations using the rest
+    spawned_.clear();
+    ready_.clear();
+    idle_.clear();
+    watches_.clear();
+    removed_.clear();
+    close(epoll_fd_);
+}
+
+void event_loop::
+add_signer(const gpgh::key &k)
+{
+    gpgme_key_ref(k.get());
+    signers_.emplace_back(k.get());
+}
+
+event_loop::op_lease event_loop::
+acquire(void)
+{
+    std::unique_ptr<op_state> op;
+    if(idle_.empty()) {
+        op = std::make_unique<op_state>(this, gpg_homedir_);
+    } else {
+        op = std::move(idle_.back());
+        idle_.pop_back();
+    }
+    op->err = GPG_ERR_NO_ERROR;
+    op->ctx.clear_signers();
+    for(const auto &k: signers_)
+        op->ctx.add_signer(k);
+    return op_lease{this, std::move(op)};
+}
+
+task<std::string> event_loop::
+encrypt(const gpgh::keylist &recipients, std::string src, bool sign,
+        gpgme_encrypt_flags_t flags)
+{
+    context::op_timer timer{context::op_kind::encrypt};
+    // The data objects must outlive the lease, which may cancel the operation
+    std::istringstream src_strm{std::move(src)};
+    std::ostringstream dest_strm{};
+    gpgh::odata src_data{src_strm};
+    gpgh::idata dest_data{dest_strm};
+    auto rkv = keylist2kvec(recipients);
+    auto op = acquire();
+    auto start = sign ? gpgme_op_encrypt_sign_start : gpgme_op_encrypt_start;
+    op.started(start(op->ctx.get(), rkv.data(), flags, src_data.get(),
+                dest_data.get()), "encrypt");
+    co_await op_done{*op};
+    src_data.rethrow_if_error();
+    dest_data.rethrow_if_error();
+    gerr_check(op->err, "encrypt");
+    co_return dest_strm.str();
+}
+
+task<std::string> event_loop::
+decrypt(std::string src, gpgme_decrypt_flags_t flags)
+{
+    auto d = co_await decrypt_recipients(std::move(src), flags);
+    co_return std::move(d.plain);
+}
+
+task<event_loop::decrypted> event_loop::
+decrypt_recipients(std::string src, gpgme_decrypt_flags_t flags)
+{
+    context::op_timer timer{context::op_kind::decrypt};
+    std::istringstream src_strm{std::move(src)};
+    std::ostringstream dest_strm{};
+    gpgh::odata src_data{src_strm};
+    gpgh::idata dest_data{dest_strm};
+    auto op = acquire();
+    op.started(gpgme_op_decrypt_ext_start(op->ctx.get(), flags,
+                src_data.get(), dest_data.get()), "decrypt");
+    co_await op_done{*op};
+    src_data.rethrow_if_error();
+    dest_data.rethrow_if_error();
+    gerr_check(op->err, "decrypt");
+    co_return decrypted{dest_strm.str(), op->ctx.op_decrypt_recipients()};
+}
+
+void event_loop::
+spawn(task<void> t)
+{
+    spawned_.push_back(std::move(t));
+    spawned_.back().start();
+}
+
+void event_loop::
+run(void)
+{
+    run_until([this]() { return spawned_.empty(); });
+    if(spawned_error_)
+        std::rethrow_exception(std::exchange(spawned_error_, nullptr));
+}
+
+void event_loop::
+run_until(const std::function<bool(void)> &done)
+{
+    while(true) {
+        while(!ready_.empty()) {
+            auto h = ready_.front();
+            ready_.pop_front();
+            h.resume();
+        }
+        reap_spawned();
+        if(done())
+            return;
+        if(watches_.empty())
+            throw gpgh::error("event_loop: tasks wait on no gpg operation");
+        poll();
+    }
+}
+
+void event_loop::
+reap_spawned(void)
+{
+    for(auto i = spawned_.begin(); i != spawned_.end();) {
+        if(!i->done()) {
+            ++i;
+            continue;
+        }
+        try {
+            i->result();
+        } catch(...) {
+            if(!spawned_error_)
+                spawned_error_ = std::current_exception();
+        }
+        i = spawned_.erase(i);
+    }
+}
+
+void event_loop::
+poll(void)
+{
+    epoll_event events[64];
+    int n = epoll_wait(epoll_fd_, events, std::size(events), -1);
+    if(n < 0) {
+        if(errno == EINTR)
+            return;
+        throw std::system_error(errno, std::system_category(), "epoll_wait");
+    }
+    for(int i = 0; i != n; ++i) {
+        auto w = static_cast<io_watch*>(events[i].data.ptr);
+        if(w->removed)
+            continue;
+        auto gerr = w->fnc(w->fnc_data, w->fd);
+        if(gpgme_err_code(gerr) != GPG_ERR_NO_ERROR && w->op->running) {
+            // As gpgme's own loop does, an I/O error ends the operation
+            auto op = w->op;
+            if(op->err == GPG_ERR_NO_ERROR)
+                op->err = gerr;
+            gerr_show(gpgme_cancel(op->ctx.get()), "event_loop");
+        }
+    }
+    removed_.clear();
+}
+
+} // namespace gpgh
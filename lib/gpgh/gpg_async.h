@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+#ifndef gpgh_gpg_async_h_included
+#define gpgh_gpg_async_h_included
+
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at your
+    option) any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <https://www.gnu.org/licenses/>.
+***/
+
+#include "gpgh/gpg_helper.h"
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gpgh {
+
+//=============================================================================
+// Lazily started coroutine, resumed by whoever co_awaits it
+//=============================================================================
+template <typename T = void>
+class task;
+
+namespace detail {
+
+template <typename T>
+class task_promise_base
+{
+    std::coroutine_handle<> continuation_{std::noop_coroutine()};
+    std::exception_ptr error_{};
+public:
+    auto initial_suspend(void) noexcept->std::suspend_always { return {}; }
+    auto final_suspend(void) noexcept
+    {
+        struct final_awaiter
+        {
+            std::coroutine_handle<> next;
+            bool await_ready(void) noexcept { return false; }
+            auto await_suspend(std::coroutine_handle<>) noexcept
+                { return next; }
+            void await_resume(void) noexcept { ; }
+        };
+        return final_awaiter{continuation_};
+    }
+    void unhandled_exception(void) noexcept
+        { error_ = std::current_exception(); }
+    void continuation(std::coroutine_handle<> h) noexcept
+        { continuation_ = h; }
+    void rethrow_if_error(void) const
+        { if(error_) std::rethrow_exception(error_); }
+};
+
+template <typename T>
+class task_promise : public task_promise_base<T>
+{
+    std::optional<T> value_;
+public:
+    auto get_return_object(void)->task<T>;
+    void return_value(T v) { value_.emplace(std::move(v)); }
+    auto result(void)->T
+        { this->rethrow_if_error(); return std::move(*value_); }
+};
+
+template <>
+class task_promise<void> : public task_promise_base<void>
+{
+public:
+    auto get_return_object(void)->task<void>;
+    void return_void(void) noexcept { ; }
+    void result(void) { this->rethrow_if_error(); }
+};
+
+} // namespace detail
+
+template <typename T>
+class task
+{
+public:
+    using promise_type = detail::task_promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task(void) = default;
+    explicit task(handle_type h) noexcept : h_{h} { ; }
+    task(task &&t) noexcept : h_{std::exchange(t.h_, {})} { ; }
+    task &operator=(task &&t) noexcept
+        { std::swap(h_, t.h_); return *this; }
+    task(const task&) = delete;
+    task &operator=(const task&) = delete;
+    ~task() { if(h_) h_.destroy(); }
+
+    bool done(void) const noexcept { return !h_ || h_.done(); }
+    // Run until the first suspension, for tasks no coroutine awaits
+    void start(void) { h_.resume(); }
+    // Result of a done task, rethrowing its exception
+    auto result(void)->T { return h_.promise().result(); }
+
+    auto operator co_await(void) noexcept
+    {
+        struct awaiter
+        {
+            handle_type h;
+            bool await_ready(void) noexcept { return h.done(); }
+            auto await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                h.promise().continuation(awaiting);
+                return h;
+            }
+            auto await_resume(void)->T { return h.promise().result(); }
+        };
+        return awaiter{h_};
+    }
+
+private:
+    handle_type h_{};
+};
+
+namespace detail {
+template <typename T>
+auto task_promise<T>::get_return_object(void)->task<T>
+    { return task<T>{task<T>::handle_type::from_promise(*this)}; }
+inline auto task_promise<void>::get_return_object(void)->task<void>
+    { return task<void>{task<void>::handle_type::from_promise(*this)}; }
+} // namespace detail
+
+//=============================================================================
+// Event loop running gpg operations asynchronously on a single thread
+// Operations started through gpgme's *_start functions hand their gpg pipes
+// to the loop via gpgme user I/O callbacks, and the loop multiplexes all of
+// them with epoll, so any number of operations may be in flight at once. Each
+// operation is a task to co_await from another task run on the loop:
+//
+//     auto dec = [](gpgh::event_loop &loop, std::string c)
+//             ->gpgh::task<void> {
+//         auto plain = co_await loop.decrypt(std::move(c));
+//         ...
+//     };
+//     for(auto &c: ciphers)
+//         loop.spawn(dec(loop, c));
+//     loop.run();
+//
+// Every operation in flight has its own gpgme context, taken from a pool the
+// loop keeps for reuse. The loop and its tasks must stay on one thread.
+//=============================================================================
+class event_loop
+{
+public:
+    explicit event_loop(const std::string &gpg_homedir = {});
+    event_loop(const event_loop&) = delete;
+    event_loop &operator=(const event_loop&) = delete;
+    ~event_loop();
+
+    // Signer for encryptions with sign set
+    void add_signer(const gpgh::key &k);
+
+    // recipients must outlive the returned task
+    auto encrypt(const gpgh::keylist &recipients, std::string src,
+            bool sign = false,
+            gpgme_encrypt_flags_t flags = (gpgme_encrypt_flags_t)0)
+        -> task<std::string>;
+    auto decrypt(std::string src,
+            gpgme_decrypt_flags_t flags = GPGME_DECRYPT_VERIFY)
+        -> task<std::string>;
+    // Also the key IDs src was encrypted to, see
+    // context::op_decrypt_recipients()
+    struct decrypted
+    {
+        std::string plain;
+        std::list<std::string> keyids;
+    };
+    auto decrypt_recipients(std::string src,
+            gpgme_decrypt_flags_t flags = GPGME_DECRYPT_VERIFY)
+        -> task<decrypted>;
+
+    // Start t, which the loop owns and runs to completion
+    void spawn(task<void> t);
+    // Run until every spawned task is done, then rethrow the exception of the
+    // first to fail, if any
+    void run(void);
+    // Run until t is done, giving its result
+    template <typename T>
+    auto run(task<T> t)->T
+    {
+        t.start();
+        run_until([&t]() { return t.done(); });
+        return t.result();
+    }
+
+    // Number of gpg operations in flight
+    auto in_flight(void) const noexcept->size_t { return in_flight_; }
+
+    // Implementation
+    struct io_watch;
+    struct op_state;
+    class op_lease;
+    class op_done;
+
+private:
+    int epoll_fd_{-1};
+    std::string gpg_homedir_;
+    gpgh::keylist signers_;
+    std::vector<std::unique_ptr<op_state>> idle_;
+    std::list<std::unique_ptr<io_watch>> watches_;
+    std::vector<std::unique_ptr<io_watch>> removed_;
+    std::deque<std::coroutine_handle<>> ready_;
+    std::list<task<void>> spawned_;
+    std::exception_ptr spawned_error_{};
+    size_t in_flight_{0};
+
+    auto acquire(void)->op_lease;
+    void run_until(const std::function<bool(void)> &done);
+    void reap_spawned(void);
+    void poll(void);
+
+    static gpgme_error_t io_add(void *data, int fd, int dir,
+            gpgme_io_cb_t fnc, void *fnc_data, void **tag);
+    static void io_remove(void *tag);
+    static void io_event(void *data, gpgme_event_io_t type, void *type_data);
+};
+
+} // namespace gpgh
+#endif // gpgh_gpg_async_h_included
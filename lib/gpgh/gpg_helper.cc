@@ -22,6 +22,7 @@
 #include <sstream>
 #include <fstream>
 #include <locale>
+#include <mutex>
 #include <system_error>
 
 namespace gpgh {
@@ -74,7 +75,8 @@ public:
 //=============================================================================
 
 // NOTE: None of these data_stream_cbs_* functions can throw as threy are all
-// called back from C
+// called back from C. Exceptions from the streambuf are saved in the
+// data_stream to be rethrown once the gpgme operation returns.
 
 ssize_t data_stream_cbs_read(void *handle, void *buffer, size_t size)
 {
@@ -84,8 +86,13 @@ ssize_t data_stream_cbs_read(void *handle, void *buffer, size_t size)
         errno = ENOBUFS;
         return -1;
     }
-    // TODO - error handling?
-    return sbuf->sgetn(reinterpret_cast<char*>(buffer), size);
+    try {
+        return sbuf->sgetn(reinterpret_cast<char*>(buffer), size);
+    } catch(...) {
+        ds->set_error(std::current_exception());
+        errno = EIO;
+        return -1;
+    }
 }
 
 ssize_t data_stream_cbs_write(void *handle, const void *buffer, size_t size)
@@ -96,8 +103,13 @@ ssize_t data_stream_cbs_write(void *handle, const void *buffer, size_t size)
         errno = ENOBUFS;
         return -1;
     }
-    // TODO - error handling?
-    return sbuf->sputn(reinterpret_cast<const char*>(buffer), size);
+    try {
+        return sbuf->sputn(reinterpret_cast<const char*>(buffer), size);
+    } catch(...) {
+        ds->set_error(std::current_exception());
+        errno = EIO;
+        return -1;
+    }
 }
 
 off_t data_stream_cbs_seek(void *handle, off_t offset, int whence)
@@ -208,6 +220,31 @@ keylist2kvec(const keylist &kl)
 // GpgME::Context wrapper
 //=============================================================================
 const char *context::gpg_version = nullptr;
+context::op_timer_fn context::op_timed_{};
+
+context::op_timer::
+~op_timer()
+{
+    if(!op_timed_)
+        return;
+    try {
+        op_timed_(op_, std::chrono::steady_clock::now() - start_);
+    } catch(...) {
+        // Timing is only reporting, it must not fail the operation
+    }
+}
+
+const char *context::
+op_name(op_kind op)
+{
+    switch(op) {
+    case op_kind::encrypt: return "encrypt";
+    case op_kind::decrypt: return "decrypt";
+    case op_kind::keylist: return "keylist";
+    case op_kind::verify: return "verify";
+    }
+    return "unknown";
+}
 
 context::
 context(void) : _ctx(nullptr, gpgme_release)
@@ -234,10 +271,22 @@ context(const std::string &gpg_homedir) : context{}
     gpgh::gerr_check(gerr, __func__);
 }
 
+std::string context::
+home_dir(void)
+{
+    for(auto info = gpgme_ctx_get_engine_info(_ctx.get()); info != nullptr;
+            info = info->next) {
+        if(info->protocol == GPGME_PROTOCOL_OpenPGP)
+            return info->home_dir != nullptr ? info->home_dir : "";
+    }
+    return {};
+}
+
 gpgh::keylist context::
 get_keys(const std::string &recipient, bool secret_only,
         std::function<bool(gpgme_key_t)> filter)
 {
+    op_timer timer{op_kind::keylist};
     keylist keys;
     gpgh::gpgme_op_keylist op_keylist(_ctx.get(), recipient, secret_only);
     do {
@@ -278,8 +327,27 @@ add_signer(const std::string &uid)
         throw std::runtime_error("gpg uid "s + uid + " not found"s);
     if(kl.size() > 1)
         throw std::runtime_error("gpg uid "s + uid + " is not unique"s);
-    auto gerr = gpgme_signers_add(_ctx.get(), kl[0].get());
+    add_signer(kl[0]);
+}
+
+void context::
+add_signer(const gpgh::key &k)
+{
+    auto gerr = gpgme_signers_add(_ctx.get(), k.get());
+    gerr_check(gerr, __func__);
+}
+
+gpgh::key context::
+get_key(const std::string &fpr, bool secret_only)
+{
+    op_timer timer{op_kind::keylist};
+    gpgme_key_t kt = nullptr;
+    auto gerr = gpgme_get_key(_ctx.get(), fpr.c_str(), &kt, secret_only);
+    if(gpg_err_code(gerr) == GPG_ERR_EOF ||
+            gpg_err_code(gerr) == GPG_ERR_NO_DATA)
+        return gpgh::key{};
     gerr_check(gerr, __func__);
+    return gpgh::key{kt};
 }
 
 void context::
@@ -294,6 +362,7 @@ op_verify_result(std::function<void(const gpgme_signature_t&)> fn)
 std::list<sig_verify_result> context::
 op_verify_result(void)
 {
+    op_timer timer{op_kind::verify};
     std::list<sig_verify_result> sig_list;
     op_verify_result([&sig_list](gpgme_signature_t sig)->void {
             sig_list.emplace_back(sig); });
@@ -309,6 +378,20 @@ op_verify_result(void)
     return sig_list;
 }
 
+std::list<std::string> context::
+op_decrypt_recipients(void)
+{
+    std::list<std::string> keyids;
+    auto res = gpgme_op_decrypt_result(_ctx.get());
+    if(res == nullptr)
+        return keyids;
+    for(auto r = res->recipients; r != nullptr; r = r->next) {
+        if(r->keyid != nullptr)
+            keyids.emplace_back(r->keyid);
+    }
+    return keyids;
+}
+
 std::string context::
 encrypt(const gpgh::keylist &recipients, const std::string &src, bool sign,
         gpgme_encrypt_flags_t flags)
@@ -340,12 +423,15 @@ void context::
 encrypt(const gpgh::keylist &recipients, std::istream &src, std::ostream &dest,
         bool sign, gpgme_encrypt_flags_t flags)
 {
+    op_timer timer{op_kind::encrypt};
     gpgh::odata src_strm{src};
     gpgh::idata dest_strm{dest};
     auto rkv = keylist2kvec(recipients);
     auto encrypt_fn = sign ? gpgme_op_encrypt_sign : gpgme_op_encrypt;
     auto gerr = encrypt_fn(_ctx.get(), rkv.data(), flags, src_strm.get(),
             dest_strm.get());
+    src_strm.rethrow_if_error();
+    dest_strm.rethrow_if_error();
     gerr_check(gerr, __func__);
 }
 
@@ -376,31 +462,35 @@ decrypt(const std::string &src, std::ostream &dest, gpgme_decrypt_flags_t flags)
 void context::
 decrypt(std::istream &src, std::ostream &dest, gpgme_decrypt_flags_t flags)
 {
+    op_timer timer{op_kind::decrypt};
     gpgh::odata src_data{src};
     gpgh::idata dest_data{dest};
     auto gerr = gpgme_op_decrypt_ext(_ctx.get(), flags, src_data.get(),
             dest_data.get());
+    src_data.rethrow_if_error();
+    dest_data.rethrow_if_error();
     gerr_check(gerr, __func__);
 }
 
 void context::
 gpg_init(void)
 {
-    // run once
-    if(gpg_version)
-        return;
-    gpgme_set_global_flag("require-gnupg", "2.1.13");
-    // initialize library (yes, check_version initializes the library)
-    gpg_version = gpgme_check_version("1.8.0");
-    if(!gpg_version)
-        throw gpgh::error("GnuPG version 1.8.0 required");
-    // check OpenPGP engine installation
-    auto gerr = gpgme_engine_check_version(GPGME_PROTOCOL_OpenPGP);
-    gerr_check(gerr, __func__);
-    // set locale
-    setlocale(LC_ALL, "");
-    gerr = gpgme_set_locale(NULL, LC_ALL, setlocale(LC_ALL, NULL));
-    gerr_check(gerr, __func__);
+    // run once, also when the first contexts are created on several threads
+    static std::once_flag once;
+    std::call_once(once, []() {
+        gpgme_set_global_flag("require-gnupg", "2.1.13");
+        // initialize library (yes, check_version initializes the library)
+        gpg_version = gpgme_check_version("1.8.0");
+        if(!gpg_version)
+            throw gpgh::error("GnuPG version 1.8.0 required");
+        // check OpenPGP engine installation
+        auto gerr = gpgme_engine_check_version(GPGME_PROTOCOL_OpenPGP);
+        gerr_check(gerr, "gpg_init");
+        // set locale
+        setlocale(LC_ALL, "");
+        gerr = gpgme_set_locale(NULL, LC_ALL, setlocale(LC_ALL, NULL));
+        gerr_check(gerr, "gpg_init");
+    });
 }
 
 } // namespace gpgh
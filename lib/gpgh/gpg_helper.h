@@ -24,12 +24,14 @@
 extern "C" {
 #include <gpgme.h>
 } // extern "C"
+#include <chrono>
 #include <stdexcept>
 #include <string>
 #include <list>
 #include <deque>
 #include <functional>
 #include <memory>
+#include <exception>
 #include <iostream>
 
 namespace gpgh {
@@ -66,6 +68,7 @@ class data_stream
 {
     data_up_t data_{nullptr, gpgme_data_release};
     std::streambuf *sb_{nullptr};
+    std::exception_ptr error_{};
 public:
     data_stream(void);
     data_stream(std::streambuf *sb) : data_stream{} { sb_ = sb; }
@@ -73,6 +76,11 @@ public:
     auto rdbuf(void) const noexcept->std::streambuf* { return sb_; }
     auto rdbuf(std::streambuf *sb) noexcept->std::streambuf*
         { return sb_ = sb; }
+    // An exception thrown by the streambuf can not propagate through gpgme,
+    // so it is captured here and the gpgme operation fails with EIO instead.
+    void set_error(std::exception_ptr e) noexcept { error_ = e; }
+    void rethrow_if_error(void) const
+        { if(error_) std::rethrow_exception(error_); }
     virtual ~data_stream() = default;
 };
 
@@ -155,9 +163,31 @@ auto gen_test_key(gpgh::context &context, const std::string &recipient) ->
 //=============================================================================
 class context
 {
+public:
+    // Kinds of operation timed
+    enum class op_kind { encrypt, decrypt, keylist, verify };
+    using op_timer_fn = std::function<void(op_kind op,
+            std::chrono::steady_clock::duration took)>;
+
+    // Times one operation, from construction until destruction, whether it
+    // succeeded or not
+    class op_timer
+    {
+        op_kind op_;
+        std::chrono::steady_clock::time_point start_;
+    public:
+        explicit op_timer(op_kind op) :
+            op_{op}, start_{std::chrono::steady_clock::now()} { ; }
+        op_timer(const op_timer&) = delete;
+        op_timer &operator=(const op_timer&) = delete;
+        ~op_timer();
+    };
+
+private:
     std::unique_ptr<gpgme_context, decltype(&gpgme_release)> _ctx;
 
     static const char *gpg_version;
+    static op_timer_fn op_timed_;
     static void gpg_init(void);
     static bool filt_true(gpgme_key_t) noexcept { return true; }
 
@@ -165,6 +195,8 @@ public:
     context(void);
     context(const std::string &gpg_homedir);
     auto get(void)->gpgme_ctx_t { return _ctx.get(); }
+    // GnuPG home directory of the context, empty for the default
+    auto home_dir(void)->std::string;
     auto get_keys(const std::string &recipient, bool secret_only = false,
             std::function<bool(gpgme_key_t)> filter = filt_true)
         -> gpgh::keylist;
@@ -172,13 +204,25 @@ public:
             bool secret_only = false,
             std::function<bool(gpgme_key_t)> filter = filt_true)
         -> gpgh::keylist;
+    // Key with exactly fingerprint fpr, null if there is none
+    auto get_key(const std::string &fpr, bool secret_only = false)
+        -> gpgh::key;
     void clear_signers(void) { gpgme_signers_clear(_ctx.get()); }
     void add_signer(const std::string &uid);
+    void add_signer(const gpgh::key &k);
     // NOTE: op_verify_result() may be called only directly after a signature
     // verification operation. The fn() handler may not perform **any** context
     // operation; if it binds the context it is probably doing something wrong.
     void op_verify_result(std::function<void(const gpgme_signature_t&)> fn);
     auto op_verify_result(void)->std::list<sig_verify_result>;
+    // Key IDs the message of the last decryption was encrypted to
+    auto op_decrypt_recipients(void)->std::list<std::string>;
+
+    // Call fn with the time each operation of every context takes, on the
+    // thread it ran on, so fn must be thread safe. Set it before any context
+    // is used.
+    static void on_op_timed(op_timer_fn fn) { op_timed_ = std::move(fn); }
+    static auto op_name(op_kind op)->const char*;
 
     // encrypt
     auto encrypt(const gpgh::keylist &recipients, const std::string &src,
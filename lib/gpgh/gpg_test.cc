@@ -19,14 +19,25 @@
 ***/
 
 #include "gpgh/gpg_helper.h"
+#include "gpgh/gpg_async.h"
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <system_error>
 #include <filesystem>
+#include <vector>
 
 namespace fs = ::std::filesystem;
 
+// Encrypt src, then decrypt it back into dest
+static gpgh::task<void>
+async_roundtrip(gpgh::event_loop &loop, const gpgh::keylist &keys,
+        std::string src, std::string &dest)
+{
+    auto cipher = co_await loop.encrypt(keys, src);
+    dest = co_await loop.decrypt(std::move(cipher));
+}
+
 int main(int argc, const char *argv[])
 {
     std::string test(argv[1]);
@@ -83,6 +94,25 @@ int main(int argc, const char *argv[])
             std::cout << "Content:\n--------\n" << data_dest <<
                 "\n--------" << std::endl;
         }
+        else if(test == "async") {
+            // many roundtrips in flight on one thread
+            constexpr size_t n = 16;
+            gpgh::event_loop loop{gpg_home};
+            std::vector<std::string> dests(n);
+            for(size_t i = 0; i != n; ++i) {
+                auto src = "async content " + std::to_string(i) + '\n';
+                data_src += src;
+                loop.spawn(async_roundtrip(loop, keys, src, dests[i]));
+            }
+            std::cout << "async in flight: " << loop.in_flight() << '\n';
+            loop.run();
+            for(const auto &d: dests)
+                data_dest += d;
+            std::cout << "async decrypt: " << data_dest.size() <<
+                " bytes read\n";
+            std::cout << "Content:\n--------\n" << data_dest <<
+                "\n--------" << std::endl;
+        }
         else {
             std::cerr << "Unrecognized test" << std::endl;
         }
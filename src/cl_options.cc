@@ -80,6 +80,13 @@ make_cl_options(const std::string &usage, const std::string &subcmd,
         .gpg_homedir = opt_as_string_or_empty("gpg-homedir"),
         .infile = opt_as_string_or_empty("infile"),
         .outfile = opt_as_string_or_empty("outfile"),
+        .read_only = !!opts.count("read-only"),
+        .prefetch = !!opts.count("prefetch"),
+        .autosave = !opts.count("no-autosave"),
+        .pager = !!opts.count("pager"),
+        .output = opt_as_string_or_empty("output"),
+        .merge_policy = opt_as_string_or_empty("policy"),
+        .stats = !!opts.count("stats"),
     };
 }
 
@@ -117,14 +124,29 @@ cl_handle(int argc, const char *argv[])
         ("uid,u", po::value<std::string>(),
             "GnuPG UID of signer and primary encryption recipient")
         ("gpg-homedir", po::value<std::string>(), "GnuPG home directory")
+        ("stats", "Print latency histograms of commands and gpg operations "
+            "to stderr on exit")
     ;
 
     // commands map
     std::map<std::string, cmd_entry> cmds_map;
 
     { // open
-        [[maybe_unused]] auto &entry = cmds_map.try_emplace("open",
+        auto &entry = cmds_map.try_emplace("open",
                 "open Options", common_opts_desc).first->second;
+        entry.vis_opts.add_options()
+            ("read-only,r", "Open without taking the lock or saving; "
+                "commands that modify the database are rejected")
+            ("prefetch", "Decrypt the few records shown by list or find in "
+                "the background, ahead of opening one")
+            ("no-autosave", "Save only on exit, rather than in the "
+                "background once edits pause")
+            ("pager", "Show output longer than the terminal a page at a "
+                "time")
+            ("output", po::value<std::string>()->default_value("text"),
+                "Format of command output: text, json or tsv")
+        ;
+        entry.all_opts.add(entry.vis_opts);
     }
 
     { // recrypt
@@ -154,6 +176,54 @@ cl_handle(int argc, const char *argv[])
         entry.args.add("outfile", 1);
     }
 
+    { // backup
+        auto &entry = cmds_map.try_emplace("backup", "backup Options",
+                common_opts_desc).first->second;
+        entry.vis_opts.add_options()
+            ("outfile", po::value<std::string>()->required(),
+                "Output file for backup")
+        ;
+        entry.all_opts.add(entry.vis_opts);
+        entry.args.add("outfile", 1);
+    }
+
+    { // restore
+        auto &entry = cmds_map.try_emplace("restore", "restore Options",
+                common_opts_desc).first->second;
+        entry.vis_opts.add_options()
+            ("infile", po::value<std::string>()->required(),
+                "Input file to restore from")
+        ;
+        entry.all_opts.add(entry.vis_opts);
+        entry.args.add("infile", 1);
+    }
+
+    { // merge
+        auto &entry = cmds_map.try_emplace("merge", "merge Options",
+                common_opts_desc).first->second;
+        entry.vis_opts.add_options()
+            ("policy", po::value<std::string>()->default_value("both"),
+                "Resolve records changed in both: ours, theirs, or both to "
+                "keep ours and add theirs renamed NAME~conflict")
+            ("infile", po::value<std::string>()->required(),
+                "Other database file to merge in")
+        ;
+        entry.all_opts.add(entry.vis_opts);
+        entry.args.add("infile", 1);
+    }
+
+    { // diff
+        auto &entry = cmds_map.try_emplace("diff", "diff Options",
+                common_opts_desc).first->second;
+        entry.vis_opts.add_options()
+            ("infile", po::value<std::string>(),
+                "Other database file to compare with, if not given print the "
+                "root hash of the database")
+        ;
+        entry.all_opts.add(entry.vis_opts);
+        entry.args.add("infile", 1);
+    }
+
     // Usage message
     auto progname = fs::path{argv[0]}.filename().string();
     auto usage = [&](void)->std::string {
@@ -167,8 +237,17 @@ cl_handle(int argc, const char *argv[])
                 progname);
         ss << std::format("  {} export [Common Options] {{outfile}}\n",
                 progname);
+        ss << std::format("  {} backup [Common Options] {{outfile}}\n",
+                progname);
+        ss << std::format("  {} restore [Common Options] {{infile}}\n",
+                progname);
+        ss << std::format("  {} merge [Common Options] [merge Options] "
+                "{{infile}}\n", progname);
+        ss << std::format("  {} diff [Common Options] [{{infile}}]\n",
+                progname);
         // We want a specific order, cmds_map.keys() would be alphabetical
-        const char *subcmds[] = {"open", "recrypt", "import", "export"};
+        const char *subcmds[] = {"open", "recrypt", "import", "export",
+            "backup", "restore", "merge", "diff"};
         ss << info_opts_vis << common_opts_desc;
         for(const auto &i: subcmds)
             ss << cmds_map.at(i).vis_opts;
@@ -21,6 +21,8 @@
 
 #include "pwdb/db.h"
 #include <algorithm>
+#include <format>
+#include <iterator>
 
 namespace pwdb {
 
@@ -28,21 +30,29 @@ namespace pwdb {
 // pwdb::pb::Record
 //=============================================================================
 void
-stream_out(const pb::Record &rcd, std::ostream &out, unsigned indent)
+stream_out(const pb::Record &rcd, std::string &buf, unsigned indent)
 {
-    std::string prefix(indent, ' ');
-    out << prefix << "comment: " << rcd.comment() << '\n';
+    auto out = std::back_inserter(buf);
+    std::format_to(out, "{:{}}comment: {}\n", "", indent, rcd.comment());
     if(rcd.recipient_size()) {
-        out << prefix << "recipients: ";
+        std::format_to(out, "{:{}}recipients: ", "", indent);
         for(int i=0; i != rcd.recipient_size(); ++i) {
             if(i != 0)
-                out << ", ";
-            out << rcd.recipient(i);
+                buf += ", ";
+            buf += rcd.recipient(i);
         }
-        out << std::endl;
+        buf += '\n';
     }
 }
 
+void
+stream_out(const pb::Record &rcd, std::ostream &out, unsigned indent)
+{
+    std::string buf;
+    stream_out(rcd, buf, indent);
+    out.write(buf.data(), buf.size()).flush();
+}
+
 //=============================================================================
 // pwdb::db
 //=============================================================================
@@ -58,10 +68,14 @@ remove(const std::string &name)
         detag(name, tag_iter);
     }
     records().erase(rcd_iter);
+    if(names_)
+        names_->erase(name);
     // NOTE: std::remove_if does not work on associative types
     for(auto i = pb_db.mutable_tags()->begin();
             i != pb_db.mutable_tags()->end(); ) {
         if(i->second.str().empty()) {
+            if(tag_names_)
+                tag_names_->erase(i->first);
             i = pb_db.mutable_tags()->erase(i);
         } else {
             ++i;
@@ -91,6 +105,8 @@ entag(const std::string &name, const std::string &tag)
     if(tag_iter == pb_db.tags().end()) {
         (*pb_db.mutable_tags())[tag] = pb::Strlist{};
         tag_iter = pb_db.mutable_tags()->find(tag);
+        if(tag_names_)
+            tag_names_->insert(tag);
     }
     tag_iter->second.add_str(name);
     return true;
@@ -105,11 +121,36 @@ detag(const std::string &name, const std::string &tag)
     if(!detag(name, tag_iter))
         return false;
     auto slp = tag_iter->second.mutable_str();
-    if(slp->empty())
+    if(slp->empty()) {
         pb_db.mutable_tags()->erase(tag_iter);
+        if(tag_names_)
+            tag_names_->erase(tag);
+    }
     return true;
 }
 
+std::vector<std::string> db::
+complete_name(const std::string &prefix) const
+{
+    if(!names_) {
+        names_.emplace();
+        for(const auto &rcd: crecords())
+            names_->insert(rcd.first);
+    }
+    return names_->complete(prefix);
+}
+
+std::vector<std::string> db::
+complete_tag(const std::string &prefix) const
+{
+    if(!tag_names_) {
+        tag_names_.emplace();
+        for(const auto &tag: pb_db.tags())
+            tag_names_->insert(tag.first);
+    }
+    return tag_names_->complete(prefix);
+}
+
 std::vector<std::string> db::
 at_tag(const std::string &tag) const
 {
@@ -130,6 +171,37 @@ comment(const std::string &name, const std::string &cmt)
     return true;
 }
 
+std::vector<std::string> db::
+key_pin(const std::string &recipient) const
+{
+    auto pin_iter = pb_db.key_pin().find(recipient);
+    if(pin_iter == pb_db.key_pin().end())
+        return {};
+    return {pin_iter->second.str().begin(), pin_iter->second.str().end()};
+}
+
+void db::
+key_pin(const std::string &recipient, const std::vector<std::string> &fprs)
+{
+    auto &sl = (*pb_db.mutable_key_pin())[recipient];
+    sl.clear_str();
+    for(const auto &fpr: fprs)
+        sl.add_str(fpr);
+}
+
+bool db::
+recipients(const std::string &name, const std::vector<std::string> &recipients)
+{
+    auto rcd_iter(records().find(name));
+    if(rcd_iter == records().end())
+        return false;
+    auto &rcd = rcd_iter->second;
+    rcd.clear_recipient();
+    for(const auto &r: recipients)
+        rcd.add_recipient(r);
+    return true;
+}
+
 std::set<std::string> db::
 tags(void) const
 {
@@ -153,30 +225,36 @@ tags(const std::string &name) const
 }
 
 void db::
-stream_out(std::ostream &out, unsigned indent) const
+stream_out(std::string &buf, unsigned indent) const
 {
-    std::string prefix(indent, ' ');
-    out << prefix << "UID: " << pb_db.uid();
-    out << std::endl;
+    auto out = std::back_inserter(buf);
+    std::format_to(out, "{:{}}UID: {}\n", "", indent, pb_db.uid());
     for(const auto &v: crecords()) {
-        out << prefix << v.first << ": {\n";
-        pwdb::stream_out(v.second, out, indent+4);
-        out << prefix << '}' << std::endl;
+        std::format_to(out, "{:{}}{}: {{\n", "", indent, v.first);
+        pwdb::stream_out(v.second, buf, indent+4);
+        std::format_to(out, "{:{}}}}\n", "", indent);
     }
-    out << prefix << "tags:\n";
-    auto tag_prefix = prefix + prefix;
+    std::format_to(out, "{:{}}tags:\n", "", indent);
     for(auto i=pb_db.tags().begin(); i != pb_db.tags().end(); ++i) {
-        out << tag_prefix << i->first << ": ";
+        std::format_to(out, "{:{}}{}: ", "", 2*indent, i->first);
         auto &sl = i->second;
         for(int r=0; r != sl.str_size(); ++r) {
             if(r != 0)
-                out << ", ";
-            out << sl.str(r);
+                buf += ", ";
+            buf += sl.str(r);
         }
-        out << std::endl;
+        buf += '\n';
     }
 }
 
+void db::
+stream_out(std::ostream &out, unsigned indent) const
+{
+    std::string buf;
+    stream_out(buf, indent);
+    out.write(buf.data(), buf.size()).flush();
+}
+
 //-----------------------------------------------------------------------------
 // pwdb::db private
 //-----------------------------------------------------------------------------
@@ -0,0 +1,337 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "pwdb/db_file.h"
+#include "pwdb/pb_gpg.h"
+#include "pwdb/sha256.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <typeinfo>
+#include <utility>
+
+using namespace std::literals::string_literals;
+
+namespace pwdb {
+
+static constexpr char magic[] = "PWDB\0CHUNKED\0v1\n";
+static constexpr size_t magic_size = sizeof(magic) - 1;
+
+// Chunk boundaries: after a record whose name hash is a multiple of
+// boundary_mod once the chunk holds min_chunk bytes, or at max_chunk bytes
+static constexpr size_t min_chunk = 16 * 1024;
+static constexpr size_t max_chunk = 1024 * 1024;
+static constexpr unsigned boundary_mod = 32;
+// Sanity limit on the ciphertext size of one chunk when reading
+static constexpr uint64_t max_blob = uint64_t{1} << 32;
+// Sanity limit on the chunk count of the header, a TiB of max_chunk chunks
+static constexpr uint64_t max_chunks = uint64_t{1} << 20;
+
+static void
+append_varint(std::string &out, uint64_t v)
+{
+    for(; v >= 0x80; v >>= 7)
+        out.push_back(static_cast<char>(v | 0x80));
+    out.push_back(static_cast<char>(v));
+}
+
+static void
+append_be(std::string &out, uint64_t v, unsigned bytes)
+{
+    while(bytes-- != 0)
+        out.push_back(static_cast<char>(v >> (8 * bytes)));
+}
+
+static uint64_t
+read_be(std::istream &in, unsigned bytes)
+{
+    uint64_t v = 0;
+    while(bytes-- != 0) {
+        const auto c = in.get();
+        if(c == std::istream::traits_type::eof())
+            throw std::runtime_error("Truncated pwdb file header");
+        v = v << 8 | static_cast<uint8_t>(c);
+    }
+    return v;
+}
+
+// Bytes left to read in in
+static uint64_t
+stream_remaining(std::istream &in)
+{
+    const auto pos = in.tellg();
+    in.seekg(0, std::ios::end);
+    const auto end = in.tellg();
+    in.seekg(pos);
+    if(pos == std::istream::pos_type(-1) ||
+            end == std::istream::pos_type(-1) || !in)
+        throw std::runtime_error("Unseekable pwdb file");
+    return static_cast<uint64_t>(end - pos);
+}
+
+// Append the serialized map entry of record name as the DB serializer would
+// write it, so a chunk of entries is itself a serialized DB of those records
+// and chunks concatenate to the whole DB
+static void
+append_record_entry(std::string &out, const std::string &name,
+        const pb::Record &rcd)
+{
+    constexpr auto ld = 2;  // length delimited wire type
+    const auto rcd_bytes = serialize_deterministic(rcd);
+    std::string entry;
+    entry.push_back(1 << 3 | ld);
+    append_varint(entry, name.size());
+    entry += name;
+    entry.push_back(2 << 3 | ld);
+    append_varint(entry, rcd_bytes.size());
+    entry += rcd_bytes;
+    out.push_back(pb::DB::kRecordsFieldNumber << 3 | ld);
+    append_varint(out, entry.size());
+    out += entry;
+}
+
+static std::vector<std::string>
+split_chunks(const pb::DB &pb_db)
+{
+    std::vector<std::string> chunks;
+    pb::DB head;
+    head.set_uid(pb_db.uid());
+    *head.mutable_tags() = pb_db.tags();
+    *head.mutable_key_pin() = pb_db.key_pin();
+    if(pb_db.has_merkle())
+        *head.mutable_merkle() = pb_db.merkle();
+    chunks.push_back(serialize_deterministic(head));
+
+    std::vector<const std::string*> names;
+    names.reserve(pb_db.records_size());
+    for(const auto &kv: pb_db.records())
+        names.push_back(&kv.first);
+    std::sort(names.begin(), names.end(),
+            [](auto *l, auto *r) { return *l < *r; });
+    std::string chunk;
+    for(auto *name: names) {
+        append_record_entry(chunk, *name, pb_db.records().at(*name));
+        if(chunk.size() >= max_chunk || (chunk.size() >= min_chunk &&
+                    sha256::hash(*name)[0] % boundary_mod == 0))
+            chunks.push_back(std::exchange(chunk, std::string{}));
+    }
+    if(!chunk.empty())
+        chunks.push_back(std::move(chunk));
+    return chunks;
+}
+
+static std::string
+digest_bytes(const std::string &chunk)
+{
+    const auto d = sha256::hash(chunk);
+    return std::string(reinterpret_cast<const char*>(d.data()), d.size());
+}
+
+// Call fn(worker_ctx, i) for each i in [0, n) on up to one thread per core.
+// A gpgme context runs one operation at a time, so each thread has its own on
+// the GnuPG home directory of ctx; none has signers. The first exception
+// thrown stops the remaining work and is rethrown once all threads are done.
+static void
+parallel_for(gpgh::context &ctx, size_t n,
+        const std::function<void(gpgh::context&, size_t)> &fn)
+{
+    const size_t nthreads = std::min<size_t>(n,
+            std::max(1u, std::thread::hardware_concurrency()));
+    if(nthreads == 0)
+        return;
+    const auto home = ctx.home_dir();
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]() {
+        try {
+            gpgh::context wctx{home};
+            for(size_t i; (i = next++) < n; )
+                fn(wctx, i);
+        } catch(...) {
+            std::lock_guard lock{error_mutex};
+            if(!error)
+                error = std::current_exception();
+            next = n;
+        }
+    };
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(nthreads - 1);
+        for(size_t t = 1; t != nthreads; ++t)
+            threads.emplace_back(worker);
+        worker();
+    }
+    if(error)
+        std::rethrow_exception(error);
+}
+
+bool
+is_chunked(std::istream &in)
+{
+    char buf[magic_size];
+    const auto pos = in.tellg();
+    const auto mask = in.exceptions();
+    in.exceptions(std::ios::badbit);
+    in.read(buf, magic_size);
+    const bool chunked = in.gcount() == magic_size &&
+        std::equal(buf, buf + magic_size, magic);
+    in.clear();
+    in.seekg(pos);
+    in.exceptions(mask);
+    return chunked;
+}
+
+verified_db
+read_db(gpgh::context &ctx, std::istream &in, chunk_cache *cache)
+{
+    verified_db ret;
+    if(!is_chunked(in)) {
+        ret.pb = decode_data<pb::DB>(ctx, in);
+        ret.sigs = ctx.op_verify_result();
+        return ret;
+    }
+
+    in.ignore(magic_size);
+    const auto count = read_be(in, 4);
+    if(count == 0)
+        throw std::runtime_error("Corrupt pwdb file: no index");
+    if(count > max_chunks)
+        throw std::runtime_error("Corrupt pwdb file: chunk count");
+    std::vector<uint64_t> sizes;
+    sizes.reserve(count);
+    for(uint64_t i = 0; i != count; ++i)
+        sizes.push_back(read_be(in, 8));
+    // The sizes are not yet verified, so check them against the bytes left
+    // before allocating for any
+    uint64_t total = 0;
+    for(auto size: sizes) {
+        if(size > max_blob)
+            throw std::runtime_error("Corrupt pwdb file: chunk size");
+        total += size;
+    }
+    if(total > stream_remaining(in))
+        throw std::runtime_error("Truncated pwdb file");
+    auto read_blob = [&in](uint64_t size) {
+        std::string blob(size, '\0');
+        in.read(blob.data(), static_cast<std::streamsize>(size));
+        if(static_cast<uint64_t>(in.gcount()) != size)
+            throw std::runtime_error("Truncated pwdb file");
+        return blob;
+    };
+
+    pb::ChunkIndex index;
+    if(!index.ParseFromString(ctx.decrypt(read_blob(sizes[0])))) {
+        throw std::runtime_error("Failed to parse "s +
+                typeid(pb::ChunkIndex).name());
+    }
+    ret.sigs = ctx.op_verify_result();
+    if(static_cast<uint64_t>(index.digest_size()) != count - 1)
+        throw std::runtime_error("Corrupt pwdb file: index mismatch");
+
+    std::vector<std::string> blobs;
+    for(uint64_t i = 1; i != count; ++i)
+        blobs.push_back(read_blob(sizes[i]));
+    std::vector<std::string> chunks(blobs.size());
+    parallel_for(ctx, blobs.size(), [&](gpgh::context &wctx, size_t i) {
+        chunks[i] = wctx.decrypt(blobs[i],
+                static_cast<gpgme_decrypt_flags_t>(0));
+        if(digest_bytes(chunks[i]) != index.digest(static_cast<int>(i)))
+            throw std::runtime_error("Corrupt pwdb file: chunk digest");
+    });
+    std::string dec_data;
+    for(auto &chunk: chunks)
+        dec_data += std::exchange(chunk, std::string{});
+    if(!ret.pb.ParseFromString(dec_data)) {
+        throw std::runtime_error("Failed to parse "s +
+                typeid(pb::DB).name());
+    }
+    if(cache != nullptr) {
+        if(cache->recipients != std::vector<std::string>{ret.pb.uid()}) {
+            cache->recipients = {ret.pb.uid()};
+            cache->ciphertext.clear();
+        }
+        for(size_t i = 0; i != blobs.size(); ++i) {
+            cache->ciphertext.insert_or_assign(
+                    index.digest(static_cast<int>(i)), std::move(blobs[i]));
+        }
+    }
+    return ret;
+}
+
+void
+write_db(gpgh::context &ctx, const std::vector<std::string> &recipients,
+        const pb::DB &pb_db, std::ostream &out, chunk_cache *cache)
+{
+    write_db(ctx, recipients, encode_keys(ctx, recipients, true), pb_db, out,
+            cache);
+}
+
+void
+write_db(gpgh::context &ctx, const std::vector<std::string> &recipients,
+        const gpgh::keylist &keys, const pb::DB &pb_db, std::ostream &out,
+        chunk_cache *cache)
+{
+    const auto chunks = split_chunks(pb_db);
+    if(cache != nullptr && cache->recipients != recipients) {
+        cache->recipients = recipients;
+        cache->ciphertext.clear();
+    }
+    pb::ChunkIndex index;
+    std::vector<std::string> blobs(chunks.size() + 1);
+    std::vector<size_t> todo;   // chunks to encrypt, by blob number
+    for(size_t i = 0; i != chunks.size(); ++i) {
+        const auto &d = *index.add_digest() = digest_bytes(chunks[i]);
+        if(cache != nullptr) {
+            auto iter = cache->ciphertext.find(d);
+            if(iter != cache->ciphertext.end()) {
+                blobs[i + 1] = iter->second;
+                continue;
+            }
+        }
+        todo.push_back(i + 1);
+    }
+    parallel_for(ctx, todo.size(), [&](gpgh::context &wctx, size_t i) {
+        blobs[todo[i]] = wctx.encrypt(keys, chunks[todo[i] - 1]);
+    });
+    if(cache != nullptr) {
+        for(auto n: todo) {
+            cache->ciphertext.try_emplace(index.digest(static_cast<int>(n - 1)),
+                    blobs[n]);
+        }
+    }
+    blobs[0] = ctx.encrypt(keys, serialize_deterministic(index), true);
+
+    std::string header{magic, magic_size};
+    append_be(header, blobs.size(), 4);
+    for(const auto &blob: blobs)
+        append_be(header, blob.size(), 8);
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    for(const auto &blob: blobs)
+        out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+}
+
+} // namespace pwdb
@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/db_merge.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace pwdb {
+
+static bool
+same_details(const pb::Record &lhs, const pb::Record &rhs)
+{
+    return lhs.comment() == rhs.comment() &&
+        std::equal(lhs.recipient().begin(), lhs.recipient().end(),
+                rhs.recipient().begin(), rhs.recipient().end());
+}
+
+static bool
+same_payload(const pb::Record &lhs, const pb::Record &rhs)
+{
+    if(lhs.payload_case() != rhs.payload_case())
+        return false;
+    if(lhs.has_data())
+        return lhs.data() == rhs.data();
+    if(lhs.has_store()) {
+        const auto &lv = lhs.store().values();
+        const auto &rv = rhs.store().values();
+        if(lv.size() != rv.size())
+            return false;
+        for(const auto &kv: lv) {
+            auto i = rv.find(kv.first);
+            if(i == rv.end() || i->second != kv.second)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool
+same_record(const pb::Record &lhs, const pb::Record &rhs)
+{
+    return same_details(lhs, rhs) && same_payload(lhs, rhs);
+}
+
+std::unordered_map<std::string, std::vector<std::string>>
+record_tags(const pb::DB &pb_db)
+{
+    std::unordered_map<std::string, std::vector<std::string>> tags;
+    tags.reserve(pb_db.records_size());
+    for(const auto &[tag, names]: pb_db.tags()) {
+        for(const auto &name: names.str())
+            tags[name].push_back(tag);
+    }
+    for(auto &kv: tags)
+        std::sort(kv.second.begin(), kv.second.end());
+    return tags;
+}
+
+sha256::digest
+record_digest(const pb::Record &rcd, const std::vector<std::string> &tags)
+{
+    sha256 h;
+    const char payload_case = static_cast<char>(rcd.payload_case());
+    h.update(&payload_case, 1);
+    if(rcd.has_data()) {
+        h.update_field(rcd.data());
+    } else if(rcd.has_store()) {
+        // Map order is unspecified, so hash in key order
+        std::vector<const std::string*> keys;
+        for(const auto &kv: rcd.store().values())
+            keys.push_back(&kv.first);
+        std::sort(keys.begin(), keys.end(),
+                [](auto *l, auto *r) { return *l < *r; });
+        for(auto *key: keys)
+            h.update_field(*key).update_field(rcd.store().values().at(*key));
+    }
+    h.update_field(rcd.comment());
+    h.update_field(std::to_string(rcd.recipient_size()));
+    for(const auto &r: rcd.recipient())
+        h.update_field(r);
+    for(const auto &tag: tags)
+        h.update_field(tag);
+    return h.finish();
+}
+
+std::unordered_map<std::string, sha256::digest>
+record_digests(const pb::DB &pb_db)
+{
+    static const std::vector<std::string> no_tags;
+    auto tags = record_tags(pb_db);
+    std::unordered_map<std::string, sha256::digest> digests;
+    digests.reserve(pb_db.records_size());
+    for(const auto &[name, rcd]: pb_db.records()) {
+        auto i = tags.find(name);
+        digests.emplace(name, record_digest(rcd,
+                    i == tags.end() ? no_tags : i->second));
+    }
+    return digests;
+}
+
+static std::string
+conflict_name(const db &cdb, const std::string &name)
+{
+    auto cname = name + conflict_suffix;
+    for(unsigned n = 2; cdb.count(cname) != 0; ++n)
+        cname = name + conflict_suffix + std::to_string(n);
+    return cname;
+}
+
+merge_result
+db_merge3(db &ours, const pb::DB &base, const pb::DB &theirs,
+        merge_policy policy)
+{
+    merge_result res;
+    auto take_theirs = [&ours, &res](const std::string &name,
+            const pb::Record &rcd) {
+        ours.add(name, rcd);
+        res.changed.push_back(name);
+    };
+
+    // Records added or modified in theirs
+    for(const auto &[name, t_rcd]: theirs.records()) {
+        auto b_iter = base.records().find(name);
+        const bool in_base = b_iter != base.records().end();
+        if(in_base && same_record(b_iter->second, t_rcd))
+            continue;
+        auto o_iter = ours.find(name);
+        if(o_iter == ours.end()) {
+            if(!in_base) {
+                take_theirs(name, t_rcd);
+            } else {
+                // removed in ours, modified in theirs
+                res.conflicts.push_back(name);
+                if(policy != merge_policy::ours)
+                    take_theirs(name, t_rcd);
+            }
+        } else if(same_record(o_iter->second, t_rcd)) {
+            continue;
+        } else if(in_base && same_record(o_iter->second, b_iter->second)) {
+            take_theirs(name, t_rcd);
+        } else {
+            res.conflicts.push_back(name);
+            if(policy == merge_policy::theirs) {
+                take_theirs(name, t_rcd);
+            } else if(policy == merge_policy::both) {
+                take_theirs(conflict_name(ours, name), t_rcd);
+            }
+        }
+    }
+
+    // Records removed in theirs
+    for(const auto &[name, b_rcd]: base.records()) {
+        if(theirs.records().count(name) != 0)
+            continue;
+        auto o_iter = ours.find(name);
+        if(o_iter == ours.end())
+            continue;
+        if(!same_record(o_iter->second, b_rcd)) {
+            // modified in ours, removed in theirs
+            res.conflicts.push_back(name);
+            if(policy != merge_policy::theirs)
+                continue;
+        }
+        ours.remove(name);
+        res.changed.push_back(name);
+    }
+
+    // Tag memberships added or removed in theirs
+    auto members = [](const pb::DB &pb_db, const std::string &tag) {
+        std::unordered_set<std::string> names;
+        if(auto i = pb_db.tags().find(tag); i != pb_db.tags().end())
+            names.insert(i->second.str().begin(), i->second.str().end());
+        return names;
+    };
+    for(const auto &[tag, t_names]: theirs.tags()) {
+        auto b_names = members(base, tag);
+        auto o_names = members(ours.pb(), tag);
+        for(const auto &name: t_names.str()) {
+            if(b_names.count(name) != 0 || ours.count(name) == 0 ||
+                    !o_names.insert(name).second)
+                continue;
+            ours.entag(name, tag);
+            res.changed.push_back(name);
+        }
+    }
+    for(const auto &[tag, b_names]: base.tags()) {
+        auto t_names = members(theirs, tag);
+        for(const auto &name: b_names.str()) {
+            if(t_names.count(name) == 0 && ours.detag(name, tag))
+                res.changed.push_back(name);
+        }
+    }
+
+    // Signer and primary recipient
+    if(theirs.uid() != base.uid() && ours.uid() == base.uid())
+        ours.uid(theirs.uid());
+
+    std::sort(res.changed.begin(), res.changed.end());
+    res.changed.erase(std::unique(res.changed.begin(), res.changed.end()),
+            res.changed.end());
+    return res;
+}
+
+merge_result
+db_merge(db &ours, const pb::DB &theirs, merge_policy policy,
+        const same_store_fn &same_store)
+{
+    static const std::vector<std::string> no_tags;
+    merge_result res;
+    const auto o_digests = record_digests(ours.pb());
+    auto o_tags = record_tags(ours.pb());
+    const auto t_tags = record_tags(theirs);
+
+    // Add any of tags not already on record dest
+    auto union_tags = [&](const std::string &dest,
+            const std::vector<std::string> &tags) {
+        auto &dest_tags = o_tags[dest];
+        bool changed = false;
+        for(const auto &tag: tags) {
+            if(std::find(dest_tags.begin(), dest_tags.end(), tag) !=
+                    dest_tags.end())
+                continue;
+            ours.entag(dest, tag);
+            dest_tags.push_back(tag);
+            changed = true;
+        }
+        if(changed)
+            res.changed.push_back(dest);
+    };
+
+    for(const auto &[name, t_rcd]: theirs.records()) {
+        auto t_iter = t_tags.find(name);
+        const auto &tags = t_iter == t_tags.end() ? no_tags : t_iter->second;
+        auto o_iter = ours.find(name);
+        if(o_iter == ours.end()) {
+            ours.add(name, t_rcd);
+            res.changed.push_back(name);
+            union_tags(name, tags);
+            continue;
+        }
+        if(o_digests.at(name) == record_digest(t_rcd, tags))
+            continue;
+        const auto &o_rcd = o_iter->second;
+        if(same_details(o_rcd, t_rcd) && (same_payload(o_rcd, t_rcd) ||
+                    same_store(o_rcd, t_rcd))) {
+            // Differ only in tags, or payloads encrypted separately
+            union_tags(name, tags);
+            continue;
+        }
+        res.conflicts.push_back(name);
+        if(policy == merge_policy::theirs) {
+            ours.add(name, t_rcd);
+            res.changed.push_back(name);
+            union_tags(name, tags);
+        } else if(policy == merge_policy::both) {
+            auto cname = conflict_name(ours, name);
+            ours.add(cname, t_rcd);
+            res.changed.push_back(cname);
+            union_tags(cname, tags);
+        }
+    }
+
+    std::sort(res.changed.begin(), res.changed.end());
+    res.changed.erase(std::unique(res.changed.begin(), res.changed.end()),
+            res.changed.end());
+    return res;
+}
+
+} // namespace pwdb
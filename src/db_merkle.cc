@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "pwdb/db_merkle.h"
+#include "pwdb/db_merge.h"
+#include "pwdb/sha256.h"
+#include <algorithm>
+#include <optional>
+
+namespace pwdb {
+
+static constexpr unsigned max_depth = 20;
+
+static std::string
+as_bytes(const sha256::digest &d)
+{
+    return std::string(reinterpret_cast<const char*>(d.data()), d.size());
+}
+
+static size_t
+bucket_of(const std::string &name, unsigned depth)
+{
+    if(depth == 0)
+        return 0;
+    auto d = sha256::hash(name);
+    const uint32_t prefix = uint32_t{d[0]} << 24 | uint32_t{d[1]} << 16 |
+        uint32_t{d[2]} << 8 | uint32_t{d[3]};
+    return prefix >> (32 - depth);
+}
+
+// Stored tree is complete and its leaves hold as many records as pb_db, so
+// safe to walk and to take the records of differing leaves from
+static bool
+valid_tree(const pb::DB &pb_db)
+{
+    const auto &merkle = pb_db.merkle();
+    if(merkle.depth() > max_depth)
+        return false;
+    const size_t nleaves = size_t{1} << merkle.depth();
+    if(size_t(merkle.node_size()) != 2 * nleaves - 1 ||
+            size_t(merkle.leaf_size()) != nleaves)
+        return false;
+    if(!std::all_of(merkle.node().begin(), merkle.node().end(),
+            [](const std::string &n) { return n.size() == 32; }))
+        return false;
+    size_t nrecords = 0;
+    for(const auto &leaf: merkle.leaf()) {
+        if(leaf.name_size() != leaf.digest_size())
+            return false;
+        nrecords += size_t(leaf.name_size());
+    }
+    return nrecords == size_t(pb_db.records_size());
+}
+
+unsigned
+merkle_depth(size_t nrecords)
+{
+    unsigned depth = 0;
+    while(depth != max_depth && (size_t{8} << depth) < nrecords)
+        ++depth;
+    return depth;
+}
+
+pb::Merkle
+merkle_build(const pb::DB &pb_db, unsigned depth)
+{
+    depth = std::min(depth, max_depth);
+    const size_t nleaves = size_t{1} << depth;
+    const auto digests = record_digests(pb_db);
+    std::vector<std::vector<const std::string*>> buckets(nleaves);
+    for(const auto &kv: digests)
+        buckets[bucket_of(kv.first, depth)].push_back(&kv.first);
+
+    pb::Merkle merkle;
+    merkle.set_depth(depth);
+    std::vector<std::string> nodes(2 * nleaves - 1);
+    sha256 h;
+    for(size_t b = 0; b != nleaves; ++b) {
+        auto &names = buckets[b];
+        std::sort(names.begin(), names.end(),
+                [](auto *l, auto *r) { return *l < *r; });
+        auto &leaf = *merkle.add_leaf();
+        h.update("\0", 1);
+        for(auto *name: names) {
+            const auto &d = digests.at(*name);
+            h.update_field(*name).update(d.data(), d.size());
+            leaf.add_name(*name);
+            leaf.add_digest(as_bytes(d));
+        }
+        nodes[nleaves - 1 + b] = as_bytes(h.finish());
+    }
+    for(size_t i = nleaves - 1; i-- != 0; ) {
+        h.update("\1", 1).update(nodes[2*i + 1]).update(nodes[2*i + 2]);
+        nodes[i] = as_bytes(h.finish());
+    }
+    for(auto &n: nodes)
+        merkle.add_node(std::move(n));
+    return merkle;
+}
+
+std::string
+merkle_root(const pb::DB &pb_db)
+{
+    auto root = valid_tree(pb_db) ? pb_db.merkle().node(0) :
+        merkle_build(pb_db).node(0);
+    sha256::digest d;
+    std::copy(root.begin(), root.end(), d.begin());
+    return to_hex(d);
+}
+
+// Records of the leaves whose hashes differ in trees of ours and theirs of
+// the same depth. Leaves are sorted by name, so each pair is merged in one
+// pass. Nothing if a leaf names a record its DB lacks, as a stale stored
+// tree may.
+static std::optional<db_diff>
+diff_trees(const pb::DB &ours, const pb::Merkle &o_tree,
+        const pb::DB &theirs, const pb::Merkle &t_tree)
+{
+    const size_t nleaves = size_t{1} << o_tree.depth();
+    db_diff diff;
+    std::vector<size_t> stack{0};
+    while(!stack.empty()) {
+        const auto i = stack.back();
+        stack.pop_back();
+        if(o_tree.node(i) == t_tree.node(i))
+            continue;
+        if(i < nleaves - 1) {
+            stack.push_back(2*i + 1);
+            stack.push_back(2*i + 2);
+            continue;
+        }
+        const auto &o_leaf = o_tree.leaf(int(i - (nleaves - 1)));
+        const auto &t_leaf = t_tree.leaf(int(i - (nleaves - 1)));
+        int o = 0, t = 0;
+        while(o != o_leaf.name_size() || t != t_leaf.name_size()) {
+            const bool o_first = t == t_leaf.name_size() ||
+                (o != o_leaf.name_size() && o_leaf.name(o) < t_leaf.name(t));
+            const bool t_first = o == o_leaf.name_size() ||
+                (t != t_leaf.name_size() && t_leaf.name(t) < o_leaf.name(o));
+            if(o_first) {
+                if(ours.records().count(o_leaf.name(o)) == 0)
+                    return std::nullopt;
+                diff.removed.push_back(o_leaf.name(o++));
+            } else if(t_first) {
+                if(theirs.records().count(t_leaf.name(t)) == 0)
+                    return std::nullopt;
+                diff.added.push_back(t_leaf.name(t++));
+            } else {
+                const auto &name = o_leaf.name(o);
+                if(ours.records().count(name) == 0 ||
+                        theirs.records().count(name) == 0)
+                    return std::nullopt;
+                if(o_leaf.digest(o) != t_leaf.digest(t))
+                    diff.changed.push_back(name);
+                ++o;
+                ++t;
+            }
+        }
+    }
+    for(auto *v: {&diff.added, &diff.removed, &diff.changed})
+        std::sort(v->begin(), v->end());
+    return diff;
+}
+
+db_diff
+merkle_diff(const pb::DB &ours, const pb::DB &theirs)
+{
+    const auto depth = valid_tree(ours) ? ours.merkle().depth() :
+        merkle_depth(ours.records_size());
+    std::optional<pb::Merkle> o_built, t_built;
+    auto tree_of = [depth](const pb::DB &pb_db,
+            std::optional<pb::Merkle> &built)->const pb::Merkle & {
+        if(valid_tree(pb_db) && pb_db.merkle().depth() == depth)
+            return pb_db.merkle();
+        return built.emplace(merkle_build(pb_db, depth));
+    };
+    if(auto diff = diff_trees(ours, tree_of(ours, o_built), theirs,
+                tree_of(theirs, t_built)))
+        return std::move(*diff);
+
+    // A stored tree was stale, so compare trees of the records themselves
+    return *diff_trees(ours, merkle_build(ours, depth), theirs,
+            merkle_build(theirs, depth));
+}
+
+} // namespace pwdb
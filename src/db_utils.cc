@@ -21,12 +21,220 @@
 
 #include "pwdb/pb_gpg.h"
 #include "pwdb/db_utils.h"
+#include "pwdb/trace.h"
+#include "gpgh/gpg_async.h"
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <typeinfo>
+
+using namespace std::literals::string_literals;
 
 namespace pwdb {
 
+static const std::string &
+digest_key(void)
+{
+    static const std::string key = []() {
+        std::random_device rd;
+        std::string k(32, '\0');
+        for(auto &c: k)
+            c = static_cast<char>(rd());
+        return k;
+    }();
+    return key;
+}
+
+sha256::digest
+store_digest(const pb::Store &store, std::vector<std::string> fprs)
+{
+    std::sort(fprs.begin(), fprs.end());
+    fprs.erase(std::unique(fprs.begin(), fprs.end()), fprs.end());
+    hmac_sha256 h{digest_key()};
+    h.update_field(serialize_deterministic(store));
+    for(const auto &fpr: fprs)
+        h.update_field(fpr);
+    return h.finish();
+}
+
+sha256::digest
+db_digest(const pb::DB &pb_db)
+{
+    auto sorted_keys = [](const auto &map) {
+        std::vector<const std::string*> keys;
+        keys.reserve(map.size());
+        for(const auto &kv: map)
+            keys.push_back(&kv.first);
+        std::sort(keys.begin(), keys.end(),
+                [](auto *l, auto *r) { return *l < *r; });
+        return keys;
+    };
+    hmac_sha256 h{digest_key()};
+    h.update_field(pb_db.uid());
+    h.update_field(std::to_string(pb_db.records_size()));
+    for(auto *name: sorted_keys(pb_db.records())) {
+        h.update_field(*name).update_field(
+                serialize_deterministic(pb_db.records().at(*name)));
+    }
+    for(auto *tag: sorted_keys(pb_db.tags())) {
+        h.update_field(*tag).update_field(
+                serialize_deterministic(pb_db.tags().at(*tag)));
+    }
+    // The count keeps pins apart from tags
+    h.update_field(std::to_string(pb_db.key_pin_size()));
+    for(auto *recipient: sorted_keys(pb_db.key_pin())) {
+        h.update_field(*recipient).update_field(
+                serialize_deterministic(pb_db.key_pin().at(*recipient)));
+    }
+    return h.finish();
+}
+
+std::vector<std::string>
+rcd_recipients(const db &cdb, const pb::Record &rcd)
+{
+    std::vector<std::string> recipients{cdb.uid()};
+    for(const auto &r: rcd.recipient()) {
+        if(std::find(recipients.begin(), recipients.end(), r) ==
+                recipients.end())
+            recipients.push_back(r);
+    }
+    return recipients;
+}
+
+// Keys of the fingerprints pinned for recipient, empty if any is unusable
+static gpgh::keylist
+pinned_keys(gpgh::context &ctx, const db &cdb, const std::string &recipient,
+        bool sign)
+{
+    gpgh::keylist keys;
+    for(const auto &fpr: cdb.key_pin(recipient)) {
+        auto k = ctx.get_key(fpr);
+        if(k == nullptr || !usable_key(k.get(), sign))
+            return {};
+        keys.push_back(std::move(k));
+    }
+    return keys;
+}
+
+gpgh::keylist
+recipient_keys(gpgh::context &ctx, db &cdb,
+        const std::vector<std::string> &recipients)
+{
+    gpgh::keylist keys;
+    for(const auto &r: recipients) {
+        const bool sign = r == cdb.uid();
+        auto rkeys = pinned_keys(ctx, cdb, r, sign);
+        if(rkeys.empty()) {
+            rkeys = encode_keys(ctx, {r}, sign);
+            if(rkeys.empty())
+                throw std::runtime_error("No encryption key for gpg uid "s + r);
+            cdb.key_pin(r, key_fprs(rkeys));
+        }
+        keys.insert(keys.end(), std::make_move_iterator(rkeys.begin()),
+                std::make_move_iterator(rkeys.end()));
+    }
+    return keys;
+}
+
+gpgh::keylist
+db_rcd_keys(gpgh::context &ctx, db &cdb, const pb::Record &rcd)
+{
+    return recipient_keys(ctx, cdb, rcd_recipients(cdb, rcd));
+}
+
+gpgh::keylist
+db_add_signer(gpgh::context &ctx, db &cdb)
+{
+    auto keys = recipient_keys(ctx, cdb, {cdb.uid()});
+    if(keys.size() != 1)
+        throw std::runtime_error("gpg uid "s + cdb.uid() + " is not unique"s);
+    auto secret = ctx.get_key(keys.front()->fpr, true);
+    if(secret == nullptr)
+        throw std::runtime_error("No secret key for gpg uid "s + cdb.uid());
+    ctx.add_signer(secret);
+    return keys;
+}
+
+std::vector<std::string>
+key_fprs(const gpgh::keylist &keys)
+{
+    std::vector<std::string> fprs;
+    for(const auto &k: keys) {
+        if(k->fpr != nullptr)
+            fprs.emplace_back(k->fpr);
+    }
+    std::sort(fprs.begin(), fprs.end());
+    fprs.erase(std::unique(fprs.begin(), fprs.end()), fprs.end());
+    return fprs;
+}
+
+// The subkey of k gpg encrypts to: the most recently created one that can
+// encrypt and is usable, null if there is none
+static gpgme_subkey_t
+encryption_subkey(gpgme_key_t k)
+{
+    gpgme_subkey_t pick = nullptr;
+    for(auto sk = k->subkeys; sk != nullptr; sk = sk->next) {
+        if(!sk->can_encrypt || sk->revoked || sk->expired || sk->disabled ||
+                sk->invalid || sk->fpr == nullptr)
+            continue;
+        if(pick == nullptr || sk->timestamp > pick->timestamp)
+            pick = sk;
+    }
+    return pick;
+}
+
+std::vector<std::string>
+encryption_fprs(const gpgh::keylist &keys)
+{
+    std::vector<std::string> fprs;
+    for(const auto &k: keys) {
+        auto sk = encryption_subkey(k.get());
+        if(sk != nullptr)
+            fprs.emplace_back(sk->fpr);
+        else if(k->fpr != nullptr)
+            fprs.emplace_back(k->fpr);
+    }
+    std::sort(fprs.begin(), fprs.end());
+    fprs.erase(std::unique(fprs.begin(), fprs.end()), fprs.end());
+    return fprs;
+}
+
+// Fingerprints of the subkeys of keyids, found by key ID among the subkeys
+// of keys, to compare with encryption_fprs. Others are left as key IDs.
+static std::vector<std::string>
+keyid_fprs(const std::vector<std::string> &keyids, const gpgh::keylist &keys)
+{
+    std::vector<std::string> fprs;
+    for(const auto &keyid: keyids) {
+        std::string fpr = keyid;
+        for(const auto &k: keys) {
+            for(auto sk = k->subkeys; sk != nullptr; sk = sk->next) {
+                if(sk->keyid != nullptr && keyid == sk->keyid &&
+                        sk->fpr != nullptr)
+                    fpr = sk->fpr;
+            }
+        }
+        fprs.push_back(std::move(fpr));
+    }
+    return fprs;
+}
+
+// Key IDs the last message decrypted by ctx was encrypted to
+static std::vector<std::string>
+decrypt_keyids(gpgh::context &ctx)
+{
+    auto keyids = ctx.op_decrypt_recipients();
+    return {keyids.begin(), keyids.end()};
+}
+
 pwdb::pb::Store
 db_open_rcd_store(gpgh::context &ctx, const pb::Record &rcd)
 {
+    trace_span span{"db_open_rcd_store"};
     pb::Store store;
     if(rcd.has_store()) {
         store = rcd.store();
@@ -36,19 +244,218 @@ db_open_rcd_store(gpgh::context &ctx, const pb::Record &rcd)
     return store;
 }
 
+pwdb::pb::Store
+db_open_rcd_store(gpgh::context &ctx, const pb::Record &rcd,
+        const gpgh::keylist &keys, sha256::digest &digest)
+{
+    auto store = db_open_rcd_store(ctx, rcd);
+    const bool encrypted = !rcd.has_store() && !rcd.data().empty();
+    digest = store_digest(store, encrypted ?
+            keyid_fprs(decrypt_keyids(ctx), keys) : std::vector<std::string>{});
+    return store;
+}
+
+pwdb::pb::Store
+db_open_rcd_store(gpgh::context &ctx, const std::string &name,
+        const pb::Record &rcd, store_cache &cache)
+{
+    trace_span span{"db_open_rcd_store cached"};
+    if(rcd.has_store() || rcd.data().empty())
+        return db_open_rcd_store(ctx, rcd);
+    if(auto store = cache.find(name, rcd.data()))
+        return std::move(*store);
+    auto store = db_open_rcd_store(ctx, rcd);
+    cache.insert(name, rcd.data(), store, decrypt_keyids(ctx));
+    return store;
+}
+
+pwdb::pb::Store
+db_open_rcd_store(gpgh::context &ctx, const std::string &name,
+        const pb::Record &rcd, const gpgh::keylist &keys,
+        sha256::digest &digest, store_cache &cache)
+{
+    trace_span span{"db_open_rcd_store cached"};
+    if(rcd.has_store() || rcd.data().empty())
+        return db_open_rcd_store(ctx, rcd, keys, digest);
+    std::vector<std::string> keyids;
+    if(auto store = cache.find(name, rcd.data(), &keyids)) {
+        digest = store_digest(*store, keyid_fprs(keyids, keys));
+        return std::move(*store);
+    }
+    auto store = db_open_rcd_store(ctx, rcd);
+    keyids = decrypt_keyids(ctx);
+    digest = store_digest(store, keyid_fprs(keyids, keys));
+    cache.insert(name, rcd.data(), store, std::move(keyids));
+    return store;
+}
+
+pwdb::pb::Store
+db_open_rcd_store(gpgh::context &ctx, const std::string &name,
+        const pb::Record &rcd, sha256::digest &digest,
+        std::vector<std::string> &keyids, store_cache &cache)
+{
+    trace_span span{"db_open_rcd_store cached"};
+    keyids.clear();
+    if(rcd.has_store() || rcd.data().empty()) {
+        auto store = db_open_rcd_store(ctx, rcd);
+        digest = store_digest(store, {});
+        return store;
+    }
+    auto store = cache.find(name, rcd.data(), &keyids);
+    if(!store) {
+        store = db_open_rcd_store(ctx, rcd);
+        keyids = decrypt_keyids(ctx);
+        cache.insert(name, rcd.data(), *store, keyids);
+    }
+    digest = store_digest(*store, {});
+    return std::move(*store);
+}
+
 void
 db_save_rcd_store(gpgh::context &ctx, db &cdb, const std::string &name,
         const pwdb::pb::Store &pb_store)
 {
-    // TODO - additional recipients
-    cdb.set_data(name, pwdb::encode_data(ctx, cdb.uid(), pb_store));
+    db_save_rcd_store(ctx, cdb, name, pb_store,
+            db_rcd_keys(ctx, cdb, cdb.at(name)));
 }
 
-void db_recrypt_rcd_stores(gpgh::context &ctx, db &cdb)
+void
+db_save_rcd_store(gpgh::context &ctx, db &cdb, const std::string &name,
+        const pwdb::pb::Store &pb_store, const gpgh::keylist &keys)
 {
-    for(auto i=cdb.begin(); i != cdb.end(); ++i) {
-        db_save_rcd_store(ctx, cdb, i->first, db_open_rcd_store(ctx, i->second));
+    trace_span span{"db_save_rcd_store"};
+    cdb.set_data(name, ctx.encrypt(keys, serialize_deterministic(pb_store)),
+            encryption_fprs(keys));
+}
+
+bool
+db_save_rcd_store(gpgh::context &ctx, db &cdb, const std::string &name,
+        const pwdb::pb::Store &pb_store, const gpgh::keylist &keys,
+        const sha256::digest &digest)
+{
+    auto fprs = encryption_fprs(keys);
+    if(store_digest(pb_store, fprs) == digest) {
+        // Already encrypted to keys, which may not have been recorded
+        cdb.key_fprs(name, fprs);
+        return false;
     }
+    db_save_rcd_store(ctx, cdb, name, pb_store, keys);
+    return true;
+}
+
+bool
+db_save_rcd_store(gpgh::context &ctx, db &cdb, const std::string &name,
+        const pwdb::pb::Store &pb_store, const gpgh::keylist &keys,
+        const sha256::digest &digest, const std::vector<std::string> &keyids)
+{
+    auto fprs = encryption_fprs(keys);
+    auto used = keyid_fprs(keyids, keys);
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+    if(used == fprs && store_digest(pb_store, {}) == digest) {
+        // Already encrypted to keys, which may not have been recorded
+        cdb.key_fprs(name, fprs);
+        return false;
+    }
+    db_save_rcd_store(ctx, cdb, name, pb_store, keys);
+    return true;
+}
+
+// Records db_recrypt_rcd_stores keeps in flight on its event loop
+static constexpr size_t recrypt_in_flight = 8;
+
+// Shared by the tasks of one db_recrypt_rcd_stores
+struct recrypt_state
+{
+    gpgh::context &ctx;
+    gpgh::event_loop &loop;
+    db &cdb;
+    const recrypt_progress_fn &progress;
+    // Records to check, with the keys of their group
+    std::vector<std::pair<const gpgh::keylist *, std::string>> todo{};
+    size_t next = 0;
+    size_t done = 0;
+    size_t count = 0;
+    bool stop = false;
+};
+
+// Take records from s.todo until none are left or s.stop is set, encrypting
+// each to its keys as db_open_rcd_store and db_save_rcd_store with a digest
+// would, but with the gpg operations co_awaited on s.loop
+static gpgh::task<void>
+recrypt_rcds(recrypt_state &s)
+{
+    while(!s.stop && s.next != s.todo.size()) {
+        const auto &[keys, name] = s.todo[s.next++];
+        try {
+            pb::Store store;
+            std::vector<std::string> fprs;
+            if(const auto &rcd = s.cdb.at(name);
+                    rcd.has_store() || rcd.data().empty()) {
+                store = db_open_rcd_store(s.ctx, rcd);
+            } else {
+                auto dec = co_await s.loop.decrypt_recipients(rcd.data());
+                const bool parsed = store.ParseFromString(dec.plain);
+                zeroize(dec.plain);
+                if(!parsed) {
+                    throw std::runtime_error(std::string("Failed to parse ") +
+                            typeid(pb::Store).name());
+                }
+                fprs = keyid_fprs({dec.keyids.begin(), dec.keyids.end()},
+                        *keys);
+            }
+            auto want = encryption_fprs(*keys);
+            if(store_digest(store, std::move(fprs)) ==
+                    store_digest(store, want)) {
+                // Already encrypted to keys, which may not have been recorded
+                s.cdb.key_fprs(name, want);
+            } else {
+                auto data = co_await s.loop.encrypt(*keys,
+                        serialize_deterministic(store));
+                s.cdb.set_data(name, std::move(data), std::move(want));
+                ++s.count;
+            }
+        } catch(...) {
+            // Let the records in flight finish, but start no more
+            s.stop = true;
+            throw;
+        }
+        if(s.progress && !s.progress(++s.done, s.todo.size()))
+            s.stop = true;
+    }
+}
+
+size_t
+db_recrypt_rcd_stores(gpgh::context &ctx, db &cdb,
+        const recrypt_progress_fn &progress)
+{
+    trace_span span{"db_recrypt_rcd_stores"};
+    std::map<std::vector<std::string>, std::vector<std::string>> groups;
+    for(const auto &[name, rcd]: cdb)
+        groups[rcd_recipients(cdb, rcd)].push_back(name);
+
+    // Records known to be encrypted to the keys need not even be decrypted
+    std::list<gpgh::keylist> group_keys;
+    gpgh::event_loop loop{ctx.home_dir()};
+    recrypt_state s{ctx, loop, cdb, progress};
+    for(const auto &[recipients, names]: groups) {
+        trace_span group_span{"recrypt group keys"};
+        const auto &keys = group_keys.emplace_back(
+                recipient_keys(ctx, cdb, recipients));
+        const auto fprs = encryption_fprs(keys);
+        for(const auto &name: names) {
+            const auto &rcd = cdb.at(name);
+            if(!rcd.has_data() || !std::equal(rcd.key_fpr().begin(),
+                        rcd.key_fpr().end(), fprs.begin(), fprs.end()))
+                s.todo.emplace_back(&keys, name);
+        }
+    }
+
+    trace_span rcds_span{"recrypt records"};
+    for(size_t i = 0; i != std::min(recrypt_in_flight, s.todo.size()); ++i)
+        loop.spawn(recrypt_rcds(s));
+    loop.run();
+    return s.count;
 }
 
 void db_decrypt_all_rcd_stores(gpgh::context &ctx, db &cdb)
@@ -58,4 +465,29 @@ void db_decrypt_all_rcd_stores(gpgh::context &ctx, db &cdb)
     }
 }
 
+db_fragment_gen
+db_decrypted_fragments(gpgh::context &ctx, const db &cdb)
+{
+    return [&ctx, &cdb, uid_done = false, rcd_iter = cdb.begin(),
+        tag_iter = cdb.pb().tags().begin()]() mutable->std::optional<pb::DB> {
+        pb::DB frag;
+        if(!uid_done) {
+            frag.set_uid(cdb.uid());
+            uid_done = true;
+        } else if(rcd_iter != cdb.end()) {
+            auto &rcd = (*frag.mutable_records())[rcd_iter->first];
+            rcd = rcd_iter->second;
+            *rcd.mutable_store() = db_open_rcd_store(ctx, rcd_iter->second);
+            rcd.clear_key_fpr();
+            ++rcd_iter;
+        } else if(tag_iter != cdb.pb().tags().end()) {
+            (*frag.mutable_tags())[tag_iter->first] = tag_iter->second;
+            ++tag_iter;
+        } else {
+            return std::nullopt;
+        }
+        return frag;
+    };
+}
+
 } // namespace pwdb
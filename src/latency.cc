@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "pwdb/latency.h"
+#include "gpgh/gpg_helper.h"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <iterator>
+
+using namespace std::literals::string_literals;
+
+namespace pwdb {
+
+//=============================================================================
+// latency_histogram
+//=============================================================================
+
+void latency_histogram::
+add(duration took)
+{
+    using std::chrono::microseconds;
+    const auto us = std::chrono::duration_cast<microseconds>(took).count();
+    const size_t i = us <= 0 ? 0 :
+        std::bit_width(static_cast<unsigned long long>(us)) - 1;
+    ++counts_[std::min(i, buckets - 1)];
+    ++count_;
+    total_ += took;
+    max_ = std::max(max_, took);
+}
+
+latency_histogram::duration latency_histogram::
+bucket_floor(size_t i)
+{
+    return std::chrono::microseconds{1ull << i};
+}
+
+//=============================================================================
+// latency_stats
+//=============================================================================
+
+void latency_stats::
+add(const std::string &name, latency_histogram::duration took)
+{
+    std::lock_guard lock{mutex_};
+    histograms_[name].add(took);
+}
+
+std::map<std::string, latency_histogram> latency_stats::
+histograms(void) const
+{
+    std::lock_guard lock{mutex_};
+    return histograms_;
+}
+
+bool latency_stats::
+empty(void) const
+{
+    std::lock_guard lock{mutex_};
+    return histograms_.empty();
+}
+
+latency_stats &
+command_latency(void)
+{
+    static latency_stats stats;
+    return stats;
+}
+
+latency_stats &
+gpg_latency(void)
+{
+    static latency_stats stats;
+    return stats;
+}
+
+void
+time_gpg_ops(void)
+{
+    gpgh::context::on_op_timed([](gpgh::context::op_kind op,
+                latency_histogram::duration took) {
+        gpg_latency().add(gpgh::context::op_name(op), took);
+    });
+}
+
+//=============================================================================
+// Printing
+//=============================================================================
+
+std::string
+format_duration(latency_histogram::duration took)
+{
+    using namespace std::chrono;
+    const auto us = duration_cast<duration<double, std::micro>>(took).count();
+    if(us < 1000.0)
+        return std::format("{:.0f}us", us);
+    if(us < 1000000.0)
+        return std::format("{:.2f}ms", us / 1000.0);
+    return std::format("{:.2f}s", us / 1000000.0);
+}
+
+void
+print_latency(std::string &out, std::string_view title,
+        const latency_stats &stats)
+{
+    constexpr size_t bar_width = 40;
+    const auto histograms = stats.histograms();
+    std::format_to(std::back_inserter(out), "{}:\n", title);
+    if(histograms.empty())
+        out += "    none\n";
+    for(const auto &[name, h]: histograms) {
+        std::format_to(std::back_inserter(out), "    {}: {}, mean {}, max {}\n",
+                name, h.count(), format_duration(h.total() / h.count()),
+                format_duration(h.max()));
+        size_t most = 0;
+        for(size_t i = 0; i != h.buckets; ++i)
+            most = std::max(most, h.bucket(i));
+        for(size_t i = 0; i != h.buckets; ++i) {
+            if(h.bucket(i) == 0)
+                continue;
+            const auto floor = i == 0 ? "0us"s :
+                format_duration(h.bucket_floor(i));
+            // At least one mark for anything counted
+            const auto bar = std::max<size_t>(1,
+                    h.bucket(i) * bar_width / most);
+            std::format_to(std::back_inserter(out), "      >= {:>8} {} {}\n",
+                    floor, std::string(bar, '#'), h.bucket(i));
+        }
+    }
+}
+
+} // namespace pwdb
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/name_trie.h"
+#include <algorithm>
+
+namespace pwdb {
+
+//-----------------------------------------------------------------------------
+// name_trie::node
+//-----------------------------------------------------------------------------
+
+std::unique_ptr<name_trie::node> name_trie::node::
+copy(void) const
+{
+    auto n = std::make_unique<node>(label, terminal);
+    n->children.reserve(children.size());
+    for(const auto &c: children)
+        n->children.push_back(c->copy());
+    return n;
+}
+
+size_t name_trie::node::
+child(char c) const
+{
+    auto i = std::lower_bound(children.begin(), children.end(), c,
+        [](const auto &n, char c) { return n->label.front() < c; });
+    return static_cast<size_t>(i - children.begin());
+}
+
+void name_trie::node::
+merge_only_child(void)
+{
+    auto only = std::move(children.front());
+    only->label.insert(0, label);
+    *this = std::move(*only);
+}
+
+//-----------------------------------------------------------------------------
+// name_trie
+//-----------------------------------------------------------------------------
+
+name_trie::
+name_trie(const name_trie &other) : size_{other.size_}
+{
+    root_.terminal = other.root_.terminal;
+    for(const auto &c: other.root_.children)
+        root_.children.push_back(c->copy());
+}
+
+name_trie &name_trie::
+operator=(const name_trie &other)
+{
+    if(this != &other)
+        *this = name_trie{other};
+    return *this;
+}
+
+bool name_trie::
+insert(std::string_view name)
+{
+    node *n = &root_;
+    while(!name.empty()) {
+        auto i = n->child(name.front());
+        if(i == n->children.size() ||
+                n->children[i]->label.front() != name.front()) {
+            n->children.insert(n->children.begin() + i,
+                    std::make_unique<node>(std::string{name}, true));
+            ++size_;
+            return true;
+        }
+        auto &c = n->children[i];
+        auto common = static_cast<size_t>(std::mismatch(name.begin(),
+                    name.end(), c->label.begin(), c->label.end()).first -
+                name.begin());
+        if(common < c->label.size()) {
+            // Split c where name leaves its label
+            auto split = std::make_unique<node>(c->label.substr(0, common));
+            c->label.erase(0, common);
+            split->children.push_back(std::move(c));
+            c = std::move(split);
+        }
+        name.remove_prefix(common);
+        n = c.get();
+    }
+    if(n->terminal)
+        return false;
+    n->terminal = true;
+    ++size_;
+    return true;
+}
+
+bool name_trie::
+erase(std::string_view name)
+{
+    // The path down, to prune and merge nodes on the way back up
+    std::vector<std::pair<node*, size_t>> path;
+    node *n = &root_;
+    while(!name.empty()) {
+        auto i = n->child(name.front());
+        if(i == n->children.size() ||
+                !name.starts_with(n->children[i]->label))
+            return false;
+        path.emplace_back(n, i);
+        name.remove_prefix(n->children[i]->label.size());
+        n = n->children[i].get();
+    }
+    if(!n->terminal)
+        return false;
+    n->terminal = false;
+    --size_;
+    // Drop nodes left with no names below, then merge the first node left
+    // with a single child and no name of its own into that child
+    for(; !path.empty(); path.pop_back()) {
+        auto [parent, i] = path.back();
+        auto &c = *parent->children[i];
+        if(c.terminal)
+            break;
+        if(c.children.empty()) {
+            parent->children.erase(parent->children.begin() + i);
+            continue;
+        }
+        if(c.children.size() == 1)
+            c.merge_only_child();
+        break;
+    }
+    return true;
+}
+
+bool name_trie::
+contains(std::string_view name) const
+{
+    const node *n = &root_;
+    while(!name.empty()) {
+        auto i = n->child(name.front());
+        if(i == n->children.size() ||
+                !name.starts_with(n->children[i]->label))
+            return false;
+        name.remove_prefix(n->children[i]->label.size());
+        n = n->children[i].get();
+    }
+    return n->terminal;
+}
+
+void name_trie::
+clear(void)
+{
+    root_ = node{};
+    size_ = 0;
+}
+
+std::vector<std::string> name_trie::
+complete(std::string_view prefix) const
+{
+    std::vector<std::string> out;
+    std::string path;   // the characters above n
+    const node *n = &root_;
+    while(!prefix.empty()) {
+        auto i = n->child(prefix.front());
+        if(i == n->children.size())
+            return out;
+        std::string_view label{n->children[i]->label};
+        auto len = std::min(prefix.size(), label.size());
+        if(prefix.substr(0, len) != label.substr(0, len))
+            return out;
+        if(prefix.size() <= label.size()) {
+            // The prefix ends along the label, so all below match
+            n = n->children[i].get();
+            break;
+        }
+        path += label;
+        prefix.remove_prefix(label.size());
+        n = n->children[i].get();
+    }
+    collect(*n, path, out);
+    return out;
+}
+
+void name_trie::
+collect(const node &n, std::string &path, std::vector<std::string> &out)
+{
+    path += n.label;
+    if(n.terminal)
+        out.push_back(path);
+    for(const auto &c: n.children)
+        collect(*c, path, out);
+    path.resize(path.size() - n.label.size());
+}
+
+} // namespace pwdb
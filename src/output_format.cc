@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/output_format.h"
+#include "pwdb/pb_json_codec.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std::literals::string_literals;
+
+namespace pwdb {
+
+output_format
+parse_output_format(std::string_view name)
+{
+    if(name == "text")
+        return output_format::text;
+    if(name == "json")
+        return output_format::json;
+    if(name == "tsv")
+        return output_format::tsv;
+    throw std::runtime_error("Unknown output format: "s + std::string{name});
+}
+
+void
+write_tsv_field(std::string &out, std::string_view s)
+{
+    while(!s.empty()) {
+        auto n = s.find_first_of("\t\n\r\\");
+        out.append(s.substr(0, n));
+        if(n == s.npos)
+            break;
+        switch(s[n]) {
+            case '\t': out.append("\\t"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            default: out.append("\\\\"); break;
+        }
+        s.remove_prefix(n + 1);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// row_writer
+//-----------------------------------------------------------------------------
+
+row_writer::
+row_writer(std::string &out, output_format fmt,
+        std::initializer_list<std::string_view> columns) :
+    out_{out}, fmt_{fmt}, columns_{columns}
+{
+    if(fmt_ == output_format::json)
+        out_.push_back('[');
+}
+
+row_writer::
+~row_writer()
+{
+    if(fmt_ == output_format::json)
+        out_.append("]\n");
+}
+
+void row_writer::
+row(std::initializer_list<std::string_view> fields)
+{
+    if(fmt_ == output_format::json) {
+        if(!first_)
+            out_.push_back(',');
+        out_.push_back('{');
+        auto c = columns_.begin();
+        for(auto f = fields.begin(); f != fields.end(); ++f, ++c) {
+            if(f != fields.begin())
+                out_.push_back(',');
+            json_codec::write_string(out_, *c);
+            out_.push_back(':');
+            json_codec::write_string(out_, *f);
+        }
+        out_.push_back('}');
+    } else {
+        for(auto f = fields.begin(); f != fields.end(); ++f) {
+            if(f != fields.begin())
+                out_.push_back('\t');
+            write_tsv_field(out_, *f);
+        }
+        out_.push_back('\n');
+    }
+    first_ = false;
+}
+
+//-----------------------------------------------------------------------------
+// dump
+//-----------------------------------------------------------------------------
+
+namespace {
+
+// Append strs joined by sep, each written by write
+template<typename R, typename F>
+void
+write_joined(std::string &out, const R &strs, char sep, F &&write)
+{
+    bool first = true;
+    for(const auto &s: strs) {
+        if(!first)
+            out.push_back(sep);
+        first = false;
+        write(out, s);
+    }
+}
+
+void
+write_json_record(std::string &out, const pb::Record &rcd)
+{
+    out.append("{\"comment\":");
+    json_codec::write_string(out, rcd.comment());
+    out.append(",\"recipient\":[");
+    write_joined(out, rcd.recipient(), ',', json_codec::write_string);
+    out.append("]}");
+}
+
+void
+write_tsv_record(std::string &out, const std::string &name,
+        const pb::Record &rcd)
+{
+    out.append("record\t");
+    write_tsv_field(out, name);
+    out.push_back('\t');
+    write_tsv_field(out, rcd.comment());
+    out.push_back('\t');
+    write_joined(out, rcd.recipient(), ',', write_tsv_field);
+    out.push_back('\n');
+}
+
+} // namespace
+
+void
+write_dump(std::string &out, output_format fmt, const db &cdb,
+        const std::vector<std::string> &names)
+{
+    const auto &pb_db = cdb.pb();
+    // All records, in order, or those named
+    std::vector<const std::string*> shown;
+    if(names.empty()) {
+        shown.reserve(pb_db.records_size());
+        for(const auto &rcd: pb_db.records())
+            shown.push_back(&rcd.first);
+        std::sort(shown.begin(), shown.end(),
+                [](auto l, auto r) { return *l < *r; });
+    } else {
+        for(const auto &n: names)
+            shown.push_back(&n);
+    }
+
+    if(fmt == output_format::tsv) {
+        if(names.empty()) {
+            out.append("uid\t");
+            write_tsv_field(out, pb_db.uid());
+            out.push_back('\n');
+        }
+        for(auto n: shown) {
+            if(auto i = cdb.find(*n); i != cdb.end()) {
+                write_tsv_record(out, *n, i->second);
+            } else {
+                out.append("missing\t");
+                write_tsv_field(out, *n);
+                out.push_back('\n');
+            }
+        }
+        if(names.empty()) {
+            for(const auto &tag: cdb.tags()) {
+                out.append("tag\t");
+                write_tsv_field(out, tag);
+                out.push_back('\t');
+                write_joined(out, pb_db.tags().at(tag).str(), ',',
+                        write_tsv_field);
+                out.push_back('\n');
+            }
+        }
+        return;
+    }
+
+    out.push_back('{');
+    if(names.empty()) {
+        out.append("\"uid\":");
+        json_codec::write_string(out, pb_db.uid());
+        out.push_back(',');
+    }
+    out.append("\"records\":{");
+    bool first = true;
+    for(auto n: shown) {
+        if(!first)
+            out.push_back(',');
+        first = false;
+        json_codec::write_string(out, *n);
+        out.push_back(':');
+        if(auto i = cdb.find(*n); i != cdb.end())
+            write_json_record(out, i->second);
+        else
+            out.append("null");
+    }
+    out.push_back('}');
+    if(names.empty()) {
+        out.append(",\"tags\":{");
+        first = true;
+        for(const auto &tag: cdb.tags()) {
+            if(!first)
+                out.push_back(',');
+            first = false;
+            json_codec::write_string(out, tag);
+            out.append(":[");
+            write_joined(out, pb_db.tags().at(tag).str(), ',',
+                    json_codec::write_string);
+            out.push_back(']');
+        }
+        out.push_back('}');
+    }
+    out.append("}\n");
+}
+
+} // namespace pwdb
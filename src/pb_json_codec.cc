@@ -0,0 +1,881 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/pb_json_codec.h"
+#include <stdexcept>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace pwdb::json_codec {
+
+using namespace std::literals::string_literals;
+
+namespace {
+
+//=============================================================================
+// Stage one - SIMD structural scanner
+// Works on 64 byte blocks, one bit per byte, following the simdjson approach:
+// find the characters escaped by odd length backslash runs, drop escaped
+// quotes, then a prefix-xor of the quotes gives the in-string mask.
+//=============================================================================
+
+constexpr size_t block_size = 64;
+
+struct block_masks
+{
+    uint64_t backslash;
+    uint64_t quote;
+    uint64_t op;
+};
+
+#if defined(__AVX2__)
+block_masks
+classify(const char *p)
+{
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i hi = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(p + 32));
+    auto eq = [&lo, &hi](char c)->uint64_t {
+        const __m256i cv = _mm256_set1_epi8(c);
+        uint64_t l = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, cv)));
+        uint64_t h = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, cv)));
+        return l | (h << 32);
+    };
+    return block_masks{
+        .backslash = eq('\\'),
+        .quote = eq('"'),
+        .op = eq('{') | eq('}') | eq('[') | eq(']') | eq(':') | eq(','),
+    };
+}
+#elif defined(__SSE2__)
+block_masks
+classify(const char *p)
+{
+    __m128i v[4];
+    for(int k = 0; k != 4; ++k)
+        v[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16*k));
+    auto eq = [&v](char c)->uint64_t {
+        const __m128i cv = _mm_set1_epi8(c);
+        uint64_t m = 0;
+        for(int k = 0; k != 4; ++k) {
+            m |= uint64_t(uint32_t(_mm_movemask_epi8(
+                            _mm_cmpeq_epi8(v[k], cv)))) << (16*k);
+        }
+        return m;
+    };
+    return block_masks{
+        .backslash = eq('\\'),
+        .quote = eq('"'),
+        .op = eq('{') | eq('}') | eq('[') | eq(']') | eq(':') | eq(','),
+    };
+}
+#else
+block_masks
+classify(const char *p)
+{
+    block_masks m{0, 0, 0};
+    for(size_t i = 0; i != block_size; ++i) {
+        const uint64_t bit = uint64_t{1} << i;
+        switch(p[i]) {
+            case '\\': m.backslash |= bit; break;
+            case '"': m.quote |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                m.op |= bit;
+                break;
+            default:
+                break;
+        }
+    }
+    return m;
+}
+#endif
+
+// Bits of the characters following an odd length run of backslashes, ie. the
+// escaped characters. prev_odd carries a run ending at the top of a block.
+uint64_t
+escaped_chars(uint64_t bs, uint64_t &prev_odd)
+{
+    constexpr uint64_t even_bits = 0x5555555555555555ull;
+    constexpr uint64_t odd_bits = ~even_bits;
+    const uint64_t start_edges = bs & ~(bs << 1);
+    const uint64_t even_start_mask = even_bits ^ prev_odd;
+    const uint64_t even_starts = start_edges & even_start_mask;
+    const uint64_t odd_starts = start_edges & ~even_start_mask;
+    const uint64_t even_carries = bs + even_starts;
+    uint64_t odd_carries = bs + odd_starts;
+    const bool ends_odd = odd_carries < bs;
+    odd_carries |= prev_odd;
+    prev_odd = ends_odd ? 1 : 0;
+    const uint64_t even_carry_ends = even_carries & ~bs;
+    const uint64_t odd_carry_ends = odd_carries & ~bs;
+    return (even_carry_ends & odd_bits) | (odd_carry_ends & even_bits);
+}
+
+uint64_t
+prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+//=============================================================================
+// Base64, as protobuf JSON encodes bytes fields
+//=============================================================================
+
+constexpr char b64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void
+write_base64(std::string &out, std::string_view in)
+{
+    out.push_back('"');
+    size_t i = 0;
+    for(; i + 3 <= in.size(); i += 3) {
+        const uint32_t v = uint32_t(uint8_t(in[i])) << 16 |
+            uint32_t(uint8_t(in[i+1])) << 8 | uint8_t(in[i+2]);
+        out.push_back(b64_chars[v >> 18]);
+        out.push_back(b64_chars[(v >> 12) & 0x3f]);
+        out.push_back(b64_chars[(v >> 6) & 0x3f]);
+        out.push_back(b64_chars[v & 0x3f]);
+    }
+    if(i + 1 == in.size()) {
+        const uint32_t v = uint32_t(uint8_t(in[i])) << 16;
+        out.push_back(b64_chars[v >> 18]);
+        out.push_back(b64_chars[(v >> 12) & 0x3f]);
+        out.append("==");
+    } else if(i + 2 == in.size()) {
+        const uint32_t v = uint32_t(uint8_t(in[i])) << 16 |
+            uint32_t(uint8_t(in[i+1])) << 8;
+        out.push_back(b64_chars[v >> 18]);
+        out.push_back(b64_chars[(v >> 12) & 0x3f]);
+        out.push_back(b64_chars[(v >> 6) & 0x3f]);
+        out.push_back('=');
+    }
+    out.push_back('"');
+}
+
+int
+base64_value(char c)
+{
+    if(c >= 'A' && c <= 'Z') return c - 'A';
+    if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if(c >= '0' && c <= '9') return c - '0' + 52;
+    if(c == '+' || c == '-') return 62;
+    if(c == '/' || c == '_') return 63;
+    return -1;
+}
+
+// Accepts the standard and URL safe alphabets, padded or not
+bool
+read_base64(std::string_view in, std::string &out)
+{
+    while(!in.empty() && in.back() == '=')
+        in.remove_suffix(1);
+    if(in.size() % 4 == 1)
+        return false;
+    out.clear();
+    out.reserve(in.size() / 4 * 3 + 2);
+    uint32_t acc = 0;
+    int bits = 0;
+    for(char c: in) {
+        const int v = base64_value(c);
+        if(v < 0)
+            return false;
+        acc = (acc << 6) | uint32_t(v);
+        bits += 6;
+        if(bits >= 8) {
+            bits -= 8;
+            out.push_back(char((acc >> bits) & 0xff));
+        }
+    }
+    return true;
+}
+
+//=============================================================================
+// Stage two - schema driven parser over the structural index
+//=============================================================================
+
+bool
+is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void
+append_utf8(std::string &out, uint32_t cp)
+{
+    if(cp < 0x80) {
+        out.push_back(char(cp));
+    } else if(cp < 0x800) {
+        out.push_back(char(0xc0 | (cp >> 6)));
+        out.push_back(char(0x80 | (cp & 0x3f)));
+    } else if(cp < 0x10000) {
+        out.push_back(char(0xe0 | (cp >> 12)));
+        out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back(char(0x80 | (cp & 0x3f)));
+    } else {
+        out.push_back(char(0xf0 | (cp >> 18)));
+        out.push_back(char(0x80 | ((cp >> 12) & 0x3f)));
+        out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back(char(0x80 | (cp & 0x3f)));
+    }
+}
+
+class parser
+{
+    std::string_view js_;
+    std::vector<uint32_t> idx_;
+    size_t i_{0};       // next entry of idx_
+    size_t gap_{0};     // offset following the last consumed structural
+
+public:
+    parser(std::string_view js) : js_{js}, idx_{structural_index(js)} { ; }
+
+    [[noreturn]] void fail(const std::string &what) const {
+        throw std::runtime_error("JSON parse error at offset "s +
+                std::to_string(gap_) + ": "s + what);
+    }
+
+    char peek(void) const { return i_ < idx_.size() ? js_[idx_[i_]] : '\0'; }
+
+    void check_gap(size_t end) const {
+        for(size_t p = gap_; p != end; ++p) {
+            if(!is_ws(js_[p]))
+                fail("unexpected character '"s + js_[p] + "'"s);
+        }
+    }
+
+    char next(void) {
+        if(i_ == idx_.size())
+            fail("unexpected end of input");
+        const auto pos = idx_[i_++];
+        check_gap(pos);
+        gap_ = pos + 1;
+        return js_[pos];
+    }
+
+    void expect(char c) {
+        if(next() != c)
+            fail("expected '"s + c + "'"s);
+    }
+
+    void finish(void) {
+        if(i_ != idx_.size())
+            fail("trailing content");
+        check_gap(js_.size());
+    }
+
+    // Literals sit between two structurals, so are found in the gap
+    auto literal_end(void) const->size_t
+        { return i_ < idx_.size() ? idx_[i_] : js_.size(); }
+
+    auto literal(void) const->std::string_view {
+        auto lit = js_.substr(gap_, literal_end() - gap_);
+        while(!lit.empty() && is_ws(lit.front()))
+            lit.remove_prefix(1);
+        while(!lit.empty() && is_ws(lit.back()))
+            lit.remove_suffix(1);
+        return lit;
+    }
+
+    bool null(void) {
+        const char c = peek();
+        if(c == '"' || c == '{' || c == '[')
+            return false;
+        const auto lit = literal();
+        if(lit != "null") {
+            // leave any other literal for the value parser
+            if(lit.empty())
+                fail("expected value");
+            return false;
+        }
+        gap_ = literal_end();
+        return true;
+    }
+
+    // Unsigned integer, as a number or a quoted number as protobuf allows
+    auto uint32(void)->uint32_t {
+        std::string_view lit;
+        if(peek() == '"') {
+            lit = raw_string();
+        } else {
+            lit = literal();
+            gap_ = literal_end();
+        }
+        if(lit.empty() || lit.size() > 10)
+            fail("expected integer");
+        uint64_t v = 0;
+        for(char c: lit) {
+            if(c < '0' || c > '9')
+                fail("expected integer");
+            v = v * 10 + uint64_t(c - '0');
+        }
+        if(v > UINT32_MAX)
+            fail("integer out of range");
+        return uint32_t(v);
+    }
+
+    auto raw_string(void)->std::string_view {
+        if(next() != '"')
+            fail("expected string");
+        const auto begin = gap_;
+        // stage one guarantees the closing quote is the next structural
+        const auto end = idx_[i_++];
+        gap_ = end + 1;
+        return js_.substr(begin, end - begin);
+    }
+
+    auto string(void)->std::string {
+        auto raw = raw_string();
+        auto bs = raw.find('\\');
+        std::string s;
+        s.reserve(raw.size());
+        while(true) {
+            auto run = raw.substr(0, bs);
+            for(char c: run) {
+                if(uint8_t(c) < 0x20)
+                    fail("control character in string");
+            }
+            s.append(run);
+            if(bs == std::string_view::npos)
+                break;
+            raw.remove_prefix(bs);
+            unescape(raw, s);
+            bs = raw.find('\\');
+        }
+        return s;
+    }
+
+    template <typename F>
+    void object(F &&member) {
+        expect('{');
+        if(peek() == '}') {
+            next();
+            return;
+        }
+        while(true) {
+            auto key = string();
+            expect(':');
+            member(key);
+            const char c = next();
+            if(c == '}')
+                return;
+            if(c != ',')
+                fail("expected ',' or '}'");
+        }
+    }
+
+    template <typename F>
+    void array(F &&element) {
+        expect('[');
+        if(peek() == ']') {
+            next();
+            return;
+        }
+        while(true) {
+            element();
+            const char c = next();
+            if(c == ']')
+                return;
+            if(c != ',')
+                fail("expected ',' or ']'");
+        }
+    }
+
+private:
+    uint32_t hex4(std::string_view &raw) {
+        if(raw.size() < 4)
+            fail("truncated \\u escape");
+        uint32_t v = 0;
+        for(int k = 0; k != 4; ++k) {
+            const char c = raw[k];
+            v <<= 4;
+            if(c >= '0' && c <= '9') v |= uint32_t(c - '0');
+            else if(c >= 'a' && c <= 'f') v |= uint32_t(c - 'a' + 10);
+            else if(c >= 'A' && c <= 'F') v |= uint32_t(c - 'A' + 10);
+            else fail("invalid \\u escape");
+        }
+        raw.remove_prefix(4);
+        return v;
+    }
+
+    // raw starts at a backslash; consume one escape sequence
+    void unescape(std::string_view &raw, std::string &s) {
+        if(raw.size() < 2)
+            fail("truncated escape");
+        const char c = raw[1];
+        raw.remove_prefix(2);
+        switch(c) {
+            case '"': s.push_back('"'); return;
+            case '\\': s.push_back('\\'); return;
+            case '/': s.push_back('/'); return;
+            case 'b': s.push_back('\b'); return;
+            case 'f': s.push_back('\f'); return;
+            case 'n': s.push_back('\n'); return;
+            case 'r': s.push_back('\r'); return;
+            case 't': s.push_back('\t'); return;
+            case 'u': break;
+            default: fail("invalid escape");
+        }
+        uint32_t cp = hex4(raw);
+        if(cp >= 0xd800 && cp < 0xdc00) {
+            if(raw.size() < 2 || raw[0] != '\\' || raw[1] != 'u')
+                fail("unpaired surrogate");
+            raw.remove_prefix(2);
+            const uint32_t lo = hex4(raw);
+            if(lo < 0xdc00 || lo >= 0xe000)
+                fail("unpaired surrogate");
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+        } else if(cp >= 0xdc00 && cp < 0xe000) {
+            fail("unpaired surrogate");
+        }
+        append_utf8(s, cp);
+    }
+};
+
+void
+parse_store(parser &p, pb::Store &store)
+{
+    p.object([&p, &store](const std::string &key) {
+        if(key != "values")
+            p.fail("unknown field \""s + key + "\" in Store"s);
+        if(p.null())
+            return;
+        auto &values = *store.mutable_values();
+        p.object([&p, &values](const std::string &k) {
+            values[k] = p.null() ? std::string{} : p.string();
+        });
+    });
+}
+
+void
+parse_record(parser &p, pb::Record &rcd)
+{
+    p.object([&p, &rcd](const std::string &key) {
+        if(key != "data" && key != "comment" && key != "recipient" &&
+                key != "key_fpr" && key != "store")
+            p.fail("unknown field \""s + key + "\" in Record"s);
+        if(p.null())
+            return;
+        if(key == "data") {
+            if(rcd.has_store())
+                p.fail("multiple values for oneof payload");
+            if(!read_base64(p.raw_string(), *rcd.mutable_data()))
+                p.fail("invalid base64 in data");
+        } else if(key == "comment") {
+            rcd.set_comment(p.string());
+        } else if(key == "recipient") {
+            p.array([&p, &rcd](void) { rcd.add_recipient(p.string()); });
+        } else if(key == "key_fpr") {
+            p.array([&p, &rcd](void) { rcd.add_key_fpr(p.string()); });
+        } else {
+            if(rcd.has_data())
+                p.fail("multiple values for oneof payload");
+            parse_store(p, *rcd.mutable_store());
+        }
+    });
+}
+
+void
+parse_merkle_leaf(parser &p, pb::MerkleLeaf &leaf)
+{
+    p.object([&p, &leaf](const std::string &key) {
+        if(key != "name" && key != "digest")
+            p.fail("unknown field \""s + key + "\" in MerkleLeaf"s);
+        if(p.null())
+            return;
+        if(key == "name") {
+            p.array([&p, &leaf](void) { leaf.add_name(p.string()); });
+        } else {
+            p.array([&p, &leaf](void) {
+                if(!read_base64(p.raw_string(), *leaf.add_digest()))
+                    p.fail("invalid base64 in digest");
+            });
+        }
+    });
+}
+
+void
+parse_merkle(parser &p, pb::Merkle &merkle)
+{
+    p.object([&p, &merkle](const std::string &key) {
+        if(key != "depth" && key != "node" && key != "leaf")
+            p.fail("unknown field \""s + key + "\" in Merkle"s);
+        if(p.null())
+            return;
+        if(key == "depth") {
+            merkle.set_depth(p.uint32());
+        } else if(key == "node") {
+            p.array([&p, &merkle](void) {
+                if(!read_base64(p.raw_string(), *merkle.add_node()))
+                    p.fail("invalid base64 in node");
+            });
+        } else {
+            p.array([&p, &merkle](void) {
+                parse_merkle_leaf(p, *merkle.add_leaf());
+            });
+        }
+    });
+}
+
+void
+parse_strlist_map(parser &p,
+        google::protobuf::Map<std::string, pb::Strlist> &map)
+{
+    p.object([&p, &map](const std::string &name) {
+        auto &sl = map[name];
+        sl.Clear();
+        if(p.null())
+            return;
+        p.object([&p, &sl](const std::string &k) {
+            if(k != "str")
+                p.fail("unknown field \""s + k + "\" in Strlist"s);
+            if(!p.null())
+                p.array([&p, &sl](void) { sl.add_str(p.string()); });
+        });
+    });
+}
+
+void
+parse_db(parser &p, pb::DB &pb_db)
+{
+    p.object([&p, &pb_db](const std::string &key) {
+        if(key != "records" && key != "uid" && key != "tags" &&
+                key != "merkle" && key != "key_pin")
+            p.fail("unknown field \""s + key + "\" in DB"s);
+        if(p.null())
+            return;
+        if(key == "records") {
+            auto &records = *pb_db.mutable_records();
+            p.object([&p, &records](const std::string &name) {
+                auto &rcd = records[name];
+                rcd.Clear();
+                if(!p.null())
+                    parse_record(p, rcd);
+            });
+        } else if(key == "uid") {
+            pb_db.set_uid(p.string());
+        } else if(key == "merkle") {
+            parse_merkle(p, *pb_db.mutable_merkle());
+        } else if(key == "key_pin") {
+            parse_strlist_map(p, *pb_db.mutable_key_pin());
+        } else {
+            parse_strlist_map(p, *pb_db.mutable_tags());
+        }
+    });
+}
+
+//=============================================================================
+// Writer helpers
+//=============================================================================
+
+// Emits "key": with the separating commas of an object's fields
+class fields
+{
+    std::string &out_;
+    bool first_{true};
+public:
+    fields(std::string &out) : out_{out} { out_.push_back('{'); }
+    ~fields() { out_.push_back('}'); }
+    void key(std::string_view k) {
+        if(!first_)
+            out_.push_back(',');
+        first_ = false;
+        write_string(out_, k);
+        out_.push_back(':');
+    }
+};
+
+template <typename Map, typename F>
+void
+write_map(std::string &out, const Map &map, F &&write_value)
+{
+    std::vector<const typename Map::value_type*> entries;
+    entries.reserve(map.size());
+    for(const auto &e: map)
+        entries.push_back(&e);
+    std::sort(entries.begin(), entries.end(), [](auto a, auto b) {
+        return a->first < b->first;
+    });
+    fields f{out};
+    for(auto e: entries) {
+        f.key(e->first);
+        write_value(out, e->second);
+    }
+}
+
+template <typename R>
+void
+write_strings(std::string &out, const R &strs)
+{
+    out.push_back('[');
+    bool first = true;
+    for(const auto &s: strs) {
+        if(!first)
+            out.push_back(',');
+        first = false;
+        write_string(out, s);
+    }
+    out.push_back(']');
+}
+
+// Length of the leading run of s that needs no escaping
+size_t
+clean_prefix(std::string_view s)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ctl_max = _mm_set1_epi8(0x1f);
+    for(; i + 16 <= s.size(); i += 16) {
+        const __m128i v = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(s.data() + i));
+        const __m128i ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, ctl_max), ctl_max);
+        const __m128i esc = _mm_or_si128(ctl, _mm_or_si128(
+                    _mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)));
+        if(const int m = _mm_movemask_epi8(esc); m != 0)
+            return i + std::countr_zero(unsigned(m));
+    }
+#endif
+    for(; i != s.size(); ++i) {
+        const char c = s[i];
+        if(c == '"' || c == '\\' || uint8_t(c) < 0x20)
+            break;
+    }
+    return i;
+}
+
+} // namespace
+
+//=============================================================================
+// Public interface
+//=============================================================================
+
+std::vector<uint32_t>
+structural_index(std::string_view json)
+{
+    std::vector<uint32_t> idx;
+    idx.reserve(json.size() / 4);
+    uint64_t prev_odd = 0;
+    uint64_t prev_in_str = 0;
+    for(size_t pos = 0; pos < json.size(); pos += block_size) {
+        const char *p = json.data() + pos;
+        char tail[block_size];
+        if(json.size() - pos < block_size) {
+            std::memset(tail, ' ', block_size);
+            std::memcpy(tail, p, json.size() - pos);
+            p = tail;
+        }
+        const auto m = classify(p);
+        const uint64_t quotes = m.quote & ~escaped_chars(m.backslash, prev_odd);
+        const uint64_t in_str = prefix_xor(quotes) ^ prev_in_str;
+        prev_in_str = uint64_t(int64_t(in_str) >> 63);
+        for(uint64_t s = (m.op & ~in_str) | quotes; s != 0; s &= s - 1)
+            idx.push_back(uint32_t(pos + std::countr_zero(s)));
+    }
+    if(prev_in_str)
+        throw std::runtime_error("JSON parse error: unterminated string");
+    return idx;
+}
+
+void
+write_string(std::string &out, std::string_view s)
+{
+    out.push_back('"');
+    while(!s.empty()) {
+        const auto n = clean_prefix(s);
+        out.append(s.substr(0, n));
+        if(n == s.size())
+            break;
+        const char c = s[n];
+        switch(c) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\b': out.append("\\b"); break;
+            case '\f': out.append("\\f"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            default: {
+                constexpr char hex[] = "0123456789abcdef";
+                out.append("\\u00");
+                out.push_back(hex[uint8_t(c) >> 4]);
+                out.push_back(hex[uint8_t(c) & 0xf]);
+            }
+        }
+        s.remove_prefix(n + 1);
+    }
+    out.push_back('"');
+}
+
+void
+write(std::string &out, const pb::Store &store)
+{
+    fields f{out};
+    if(!store.values().empty()) {
+        f.key("values");
+        write_map(out, store.values(), write_string);
+    }
+}
+
+void
+write(std::string &out, const pb::Record &rcd)
+{
+    // Fields in field number order, as the reflection printer does
+    fields f{out};
+    if(rcd.has_data()) {
+        f.key("data");
+        write_base64(out, rcd.data());
+    }
+    if(!rcd.comment().empty()) {
+        f.key("comment");
+        write_string(out, rcd.comment());
+    }
+    if(rcd.recipient_size() != 0) {
+        f.key("recipient");
+        write_strings(out, rcd.recipient());
+    }
+    if(rcd.key_fpr_size() != 0) {
+        f.key("key_fpr");
+        write_strings(out, rcd.key_fpr());
+    }
+    if(rcd.has_store()) {
+        f.key("store");
+        write(out, rcd.store());
+    }
+}
+
+void
+write(std::string &out, const pb::DB &pb_db)
+{
+    fields f{out};
+    if(!pb_db.records().empty()) {
+        f.key("records");
+        write_map(out, pb_db.records(),
+                [](std::string &o, const pb::Record &rcd) { write(o, rcd); });
+    }
+    if(!pb_db.uid().empty()) {
+        f.key("uid");
+        write_string(out, pb_db.uid());
+    }
+    auto write_strlist = [](std::string &o, const pb::Strlist &sl) {
+        fields sf{o};
+        if(sl.str_size() != 0) {
+            sf.key("str");
+            write_strings(o, sl.str());
+        }
+    };
+    if(!pb_db.tags().empty()) {
+        f.key("tags");
+        write_map(out, pb_db.tags(), write_strlist);
+    }
+    if(pb_db.has_merkle()) {
+        f.key("merkle");
+        fields mf{out};
+        if(pb_db.merkle().depth() != 0) {
+            mf.key("depth");
+            out.append(std::to_string(pb_db.merkle().depth()));
+        }
+        if(pb_db.merkle().node_size() != 0) {
+            mf.key("node");
+            out.push_back('[');
+            bool first = true;
+            for(const auto &node: pb_db.merkle().node()) {
+                if(!first)
+                    out.push_back(',');
+                first = false;
+                write_base64(out, node);
+            }
+            out.push_back(']');
+        }
+        if(pb_db.merkle().leaf_size() != 0) {
+            mf.key("leaf");
+            out.push_back('[');
+            bool first = true;
+            for(const auto &leaf: pb_db.merkle().leaf()) {
+                if(!first)
+                    out.push_back(',');
+                first = false;
+                fields lf{out};
+                if(leaf.name_size() != 0) {
+                    lf.key("name");
+                    write_strings(out, leaf.name());
+                }
+                if(leaf.digest_size() != 0) {
+                    lf.key("digest");
+                    out.push_back('[');
+                    bool first_digest = true;
+                    for(const auto &d: leaf.digest()) {
+                        if(!first_digest)
+                            out.push_back(',');
+                        first_digest = false;
+                        write_base64(out, d);
+                    }
+                    out.push_back(']');
+                }
+            }
+            out.push_back(']');
+        }
+    }
+    if(!pb_db.key_pin().empty()) {
+        f.key("key_pin");
+        write_map(out, pb_db.key_pin(), write_strlist);
+    }
+}
+
+void
+parse(std::string_view json, pb::Store &store)
+{
+    store.Clear();
+    parser p{json};
+    parse_store(p, store);
+    p.finish();
+}
+
+void
+parse(std::string_view json, pb::Record &rcd)
+{
+    rcd.Clear();
+    parser p{json};
+    parse_record(p, rcd);
+    p.finish();
+}
+
+void
+parse(std::string_view json, pb::DB &pb_db)
+{
+    pb_db.Clear();
+    parser p{json};
+    parse_db(p, pb_db);
+    p.finish();
+}
+
+} // namespace pwdb::json_codec
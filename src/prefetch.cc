@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/prefetch.h"
+#include <algorithm>
+
+namespace pwdb {
+
+prefetcher::
+~prefetcher()
+{
+    {
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+        queue_.clear();
+    }
+    cv_.notify_all();
+    if(thread_.joinable())
+        thread_.join();
+}
+
+void prefetcher::
+start(std::vector<job> jobs)
+{
+    {
+        std::lock_guard lock{mutex_};
+        if(stop_)
+            return;
+        queue_.assign(std::make_move_iterator(jobs.begin()),
+                std::make_move_iterator(jobs.end()));
+    }
+    if(!thread_.joinable())
+        thread_ = std::thread{&prefetcher::work, this};
+    cv_.notify_all();
+}
+
+void prefetcher::
+cancel(const std::string &keep)
+{
+    {
+        std::lock_guard lock{mutex_};
+        std::erase_if(queue_, [&keep](const job &j) {
+            return j.name != keep;
+        });
+    }
+    cv_.notify_all();
+}
+
+void prefetcher::
+wait(const std::string &name)
+{
+    std::unique_lock lock{mutex_};
+    cv_.wait(lock, [this, &name]() {
+        return busy_.count(name) == 0 && std::none_of(queue_.begin(),
+                queue_.end(), [&name](const job &j) { return j.name == name; });
+    });
+}
+
+void prefetcher::
+work(void)
+{
+    try {
+        gpgh::event_loop loop{gpg_homedir_};
+        while(true) {
+            size_t n;
+            {
+                std::unique_lock lock{mutex_};
+                cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+                if(stop_)
+                    return;
+                n = std::min(queue_.size(), max_in_flight);
+            }
+            for(size_t i = 0; i != n; ++i)
+                loop.spawn(fetch(loop));
+            loop.run();
+        }
+    } catch(...) {
+        // Prefetching is only an optimization, opening decrypts anyway
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+        queue_.clear();
+        busy_.clear();
+    }
+    cv_.notify_all();
+}
+
+gpgh::task<void> prefetcher::
+fetch(gpgh::event_loop &loop)
+{
+    while(true) {
+        job j;
+        {
+            std::lock_guard lock{mutex_};
+            if(stop_ || queue_.empty())
+                co_return;
+            j = std::move(queue_.front());
+            queue_.pop_front();
+            busy_.insert(j.name);
+        }
+        try {
+            auto d = co_await loop.decrypt_recipients(j.data);
+            pb::Store store;
+            if(store.ParseFromString(d.plain)) {
+                cache_.insert(j.name, j.data, store,
+                        {d.keyids.begin(), d.keyids.end()});
+            }
+            zeroize(d.plain);
+        } catch(const std::exception &) {
+            // Left for opening the record to report
+        }
+        {
+            std::lock_guard lock{mutex_};
+            busy_.erase(busy_.find(j.name));
+        }
+        cv_.notify_all();
+    }
+}
+
+} // namespace pwdb
@@ -23,76 +23,569 @@
 #include "pwdb/cl_options.h"
 #include "pwdb/pwdb_cmd_interp.h"
 #include "pwdb/db_utils.h"
+#include "pwdb/db_merge.h"
+#include "pwdb/db_merkle.h"
+#include "pwdb/db_file.h"
 #include "pwdb/util.h"
 #include "pwdb/pb_gpg.h"
 #include "pwdb/pb_json.h"
+#include "pwdb/latency.h"
+#include "pwdb/trace.h"
+#include <google/protobuf/util/message_differencer.h>
+#include <exception>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <format>
+#include <iterator>
 #include <system_error>
 #include <filesystem>
+#include <optional>
+#include <span>
+#include <spanstream>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+extern "C" {
+#include <unistd.h>
+} // extern "C"
 
 using namespace std::literals::string_literals;
 namespace fs = std::filesystem;
+namespace gpu = google::protobuf::util;
 
-void check_uid(gpgh::context &ctx, const std::string &uid)
+// How long to wait for another writer to finish saving
+constexpr std::chrono::seconds lock_wait{10};
+// How often long running work saves its progress
+constexpr std::chrono::seconds checkpoint_interval{60};
+// How often an open session idle at the prompt checks for reloaded versions
+constexpr std::chrono::milliseconds reload_interval{250};
+// How long an open session waits for edits to stop before saving them
+constexpr std::chrono::seconds autosave_delay{5};
+
+// Check the uid has a key, pinning it in cdb if not already. Gives the
+// warning to show if it has none.
+static std::optional<std::string>
+uid_key_warning(gpgh::context &ctx, pwdb::db &cdb)
 {
-    auto keys = ctx.get_keys(uid, false,
-            [](gpgme_key_t k)->bool {return k->can_encrypt && k->can_sign;});
-    if(keys.empty()) {
-        std::cerr << "WARNING: No suitable key found for uid " << uid <<
-            std::endl;
-        std::cerr << "\tChanges will NOT be saved!\n";
+    try {
+        pwdb::recipient_keys(ctx, cdb, {cdb.uid()});
+    } catch(const std::runtime_error &) {
+        return "WARNING: No suitable key found for uid "s + cdb.uid() +
+            "\n\tChanges will NOT be saved!\n"s;
     }
+    return std::nullopt;
 }
 
-void check_gpg_verify_result(gpgh::context &ctx)
+void check_uid(gpgh::context &ctx, pwdb::db &cdb)
 {
-    auto siglist = ctx.op_verify_result();
-    for(const auto &sig: siglist) {
+    if(auto warning = uid_key_warning(ctx, cdb))
+        std::cerr << *warning << std::flush;
+}
+
+struct uid_check_result
+{
+    std::vector<std::string> pins;      // of the uid, once checked
+    std::optional<std::string> warning; // for the session to show
+};
+
+// check_uid in the background, on a copy of the uid and pins of cdb as the
+// session may change cdb meanwhile. The warning is returned rather than
+// written, as the terminal belongs to the prompt meanwhile.
+static std::future<uid_check_result>
+check_uid_async(const pwdb::db &cdb, const std::string &gpg_homedir)
+{
+    pwdb::pb::DB pins;
+    pins.set_uid(cdb.uid());
+    *pins.mutable_key_pin() = cdb.pb().key_pin();
+    return std::async(std::launch::async,
+            [pins = std::move(pins), gpg_homedir]() mutable {
+        pwdb::db pdb{std::move(pins)};
+        gpgh::context ctx{gpg_homedir};
+        uid_check_result res;
+        res.warning = uid_key_warning(ctx, pdb);
+        res.pins = pdb.key_pin(pdb.uid());
+        return res;
+    });
+}
+
+// Report sigs to out, stdout unless that is kept for machine readable output
+void check_gpg_verify_result(const std::list<gpgh::sig_verify_result> &sigs,
+        std::ostream &out = std::cout)
+{
+    for(const auto &sig: sigs) {
         std::string uid("<unknown>");
         if(sig.key != nullptr)
             uid = sig.key->uids->uid;
 
         if(sig.summary & GPGME_SIGSUM_VALID)
-            std::cout << std::format("Signature {} good\n", uid);
+            out << std::format("Signature {} good\n", uid);
         else if(sig.summary & GPGME_SIGSUM_GREEN)
-            std::cout << std::format("Signature {} ok\n", uid);
+            out << std::format("Signature {} ok\n", uid);
         else if(sig.summary & GPGME_SIGSUM_RED)
-            std::cout << std::format("WARNING: Signature {} invalid\n", uid);
+            out << std::format("WARNING: Signature {} invalid\n", uid);
         else
-            std::cout << std::format("WARNING: Signature {} could not be "
+            out << std::format("WARNING: Signature {} could not be "
                     "verified\n", uid);
-        std::cout << std::flush;
+        out << std::flush;
     }
 }
 
-static void
-read_from_pwdb(pwdb::db &cdb, const std::string &pwdb_file,
-        const std::string &gpg_homedir)
+void check_gpg_verify_result(gpgh::context &ctx)
+{
+    check_gpg_verify_result(ctx.op_verify_result());
+}
+
+static auto
+read_pwdb_file(const std::string &pwdb_file, const std::string &gpg_homedir,
+        pwdb::chunk_cache *cache = nullptr)->pwdb::verified_db
 {
     std::ifstream ifs(pwdb_file, std::ios::in | std::ios::binary);
     ifs.exceptions(std::ios::badbit | std::ios::failbit);
     gpgh::context ctx{gpg_homedir};
-    cdb = pwdb::decode_data<pwdb::pb::DB>(ctx, ifs);
-    check_gpg_verify_result(ctx);
+    return pwdb::read_db(ctx, ifs, cache);
+}
+
+static std::string
+read_whole_file(const std::string &file)
+{
+    std::ifstream ifs(file, std::ios::in | std::ios::binary);
+    ifs.exceptions(std::ios::badbit | std::ios::failbit);
+    return {std::istreambuf_iterator<char>{ifs},
+        std::istreambuf_iterator<char>{}};
+}
+
+static void
+read_from_pwdb(pwdb::db &cdb, const std::string &pwdb_file,
+        const std::string &gpg_homedir, pwdb::chunk_cache *cache = nullptr)
+{
+    pwdb::trace_span span{"read_from_pwdb", pwdb_file};
+    auto vdb = read_pwdb_file(pwdb_file, gpg_homedir, cache);
+    check_gpg_verify_result(vdb.sigs);
+    cdb = std::move(vdb.pb);
+}
+
+// Writer of cdb for lock_overwrite_file, reusing the ciphertext of unchanged
+// chunks from cache if given
+static std::function<void(std::ostream&)>
+pwdb_writer(pwdb::db &cdb, const std::string &gpg_homedir,
+        pwdb::chunk_cache *cache)
+{
+    // Refresh the content hash tree, signed along with the records it covers
+    cdb.merkle(pwdb::merkle_build(cdb.pb()));
+    return [&cdb, &gpg_homedir, cache](std::ostream &out) {
+        gpgh::context ctx{gpg_homedir};
+        auto keys = pwdb::db_add_signer(ctx, cdb);
+        pwdb::write_db(ctx, {cdb.uid()}, keys, cdb.pb(), out, cache);
+    };
+}
+
+// Save cdb, reusing the ciphertext of unchanged chunks from cache if given
+static void
+save_to_pwdb(pwdb::lock_overwrite_file &db_file_lock, pwdb::db &cdb,
+        const std::string &gpg_homedir, pwdb::chunk_cache *cache = nullptr)
+{
+    db_file_lock.overwrite(pwdb_writer(cdb, gpg_homedir, cache));
+}
+
+// Save cdb as save_to_pwdb does, keeping the lock
+static void
+checkpoint_pwdb(pwdb::lock_overwrite_file &db_file_lock, pwdb::db &cdb,
+        const std::string &gpg_homedir, pwdb::chunk_cache *cache = nullptr)
+{
+    db_file_lock.checkpoint(pwdb_writer(cdb, gpg_homedir, cache));
+}
+
+//-----------------------------------------------------------------------------
+struct own_saves
+// Generation of the file last saved by this session, for db_reloader to skip
+// rather than decrypt again. A save holds mtx from writing the file until it
+// has set last, so the reloader never sees the new file before last.
+//-----------------------------------------------------------------------------
+{
+    std::mutex mtx;
+    pwdb::file_generation last{};
+};
+
+//-----------------------------------------------------------------------------
+class db_reloader
+// Decrypt each new version of the database file in the background as it gets
+// replaced (e.g. by a sync from another host), for the open session to merge
+// in between commands. Versions the session saved itself are skipped.
+//-----------------------------------------------------------------------------
+{
+public:
+    struct version
+    {
+        pwdb::file_generation gen;
+        pwdb::verified_db vdb;
+        pwdb::chunk_cache cache;
+    };
+
+    db_reloader(const std::string &db_file, const std::string &gpg_homedir,
+            const pwdb::file_generation &gen, own_saves &own) :
+        db_file_{db_file}, gpg_homedir_{gpg_homedir}, own_{own},
+        watch_{db_file}, thread_{[this, gen](std::stop_token stop) { run(stop, gen); }}
+    { ; }
+
+    // Newest version decrypted since the last call, if any
+    auto take(void)->std::optional<version>
+    {
+        std::lock_guard lock{mtx_};
+        return std::exchange(pending_, std::nullopt);
+    }
+    // Error of the last failed decrypt since the last call, if any
+    auto take_error(void)->std::optional<std::string>
+    {
+        std::lock_guard lock{mtx_};
+        return std::exchange(error_, std::nullopt);
+    }
+    // Whether take or take_error has anything to return
+    bool pending(void)
+    {
+        std::lock_guard lock{mtx_};
+        return pending_ || error_;
+    }
+private:
+    void run(std::stop_token stop, pwdb::file_generation gen)
+    {
+        while(!stop.stop_requested()) {
+            if(!watch_.wait(std::chrono::milliseconds{250}))
+                continue;
+            pwdb::file_generation new_gen;
+            {
+                std::lock_guard own_lock{own_.mtx};
+                new_gen = pwdb::get_file_generation(db_file_);
+                if(new_gen == own_.last)
+                    gen = new_gen;
+            }
+            if(!new_gen.exists || new_gen == gen)
+                continue;
+            try {
+                version v{.gen = new_gen};
+                v.vdb = read_pwdb_file(db_file_, gpg_homedir_, &v.cache);
+                gen = new_gen;
+                std::lock_guard lock{mtx_};
+                pending_ = std::move(v);
+            } catch(const std::exception &e) {
+                // e.g. a partially written file, retried on its next change
+                std::lock_guard lock{mtx_};
+                error_ = e.what();
+            }
+        }
+    }
+
+    std::string db_file_;
+    std::string gpg_homedir_;
+    own_saves &own_;
+    std::mutex mtx_;
+    std::optional<version> pending_;
+    std::optional<std::string> error_;
+    pwdb::file_watch watch_;
+    std::jthread thread_;   // last, so stopped before the above are destroyed
+};
+
+//-----------------------------------------------------------------------------
+class db_autosaver
+// Save snapshots of the open database in the background, so edits reach the
+// disk during the session without the prompt waiting on encryption. Snapshots
+// submitted less than the delay apart are coalesced, only the last is saved.
+//-----------------------------------------------------------------------------
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct saved
+    {
+        pwdb::file_generation gen;  // of the file as saved
+        pwdb::pb::DB pb;
+    };
+
+    db_autosaver(const std::string &db_file, const std::string &gpg_homedir,
+            clock::duration delay, pwdb::chunk_cache cache, own_saves &own) :
+        db_file_{db_file}, gpg_homedir_{gpg_homedir}, delay_{delay},
+        cache_{std::move(cache)}, own_{own},
+        thread_{[this](std::stop_token stop) { run(stop); }}
+    { ; }
+
+    // Save pb, a snapshot of the database read from file generation gen, once
+    // no other is submitted for the delay. Replaces any snapshot not yet being
+    // saved. It is dropped if the file has changed since gen, to be merged
+    // and submitted again.
+    void submit(pwdb::pb::DB pb, const pwdb::file_generation &gen)
+    {
+        {
+            std::lock_guard lock{mtx_};
+            pending_ = snapshot{std::move(pb), gen, clock::now() + delay_};
+        }
+        cv_.notify_all();
+    }
+    // Last snapshot saved since the last call, if any
+    auto take(void)->std::optional<saved>
+    {
+        std::lock_guard lock{mtx_};
+        return std::exchange(saved_, std::nullopt);
+    }
+    // Error of the last failed save since the last call, if any
+    auto take_error(void)->std::optional<std::string>
+    {
+        std::lock_guard lock{mtx_};
+        return std::exchange(error_, std::nullopt);
+    }
+    // Finish any save under way, dropping a snapshot not yet being saved, and
+    // return the chunk cache for the final save to reuse
+    auto stop(void)->pwdb::chunk_cache
+    {
+        thread_.request_stop();
+        if(thread_.joinable())
+            thread_.join();
+        return std::move(cache_);
+    }
+private:
+    struct snapshot
+    {
+        pwdb::pb::DB pb;
+        pwdb::file_generation gen;
+        clock::time_point due;
+    };
+
+    void run(std::stop_token stop)
+    {
+        std::unique_lock lock{mtx_};
+        while(cv_.wait(lock, stop, [this]() { return pending_.has_value(); })) {
+            // Each submit moves the due time on, so wait until it stays put
+            auto due = pending_->due;
+            if(clock::now() < due) {
+                cv_.wait_until(lock, stop, due, []() { return false; });
+                continue;
+            }
+            auto snap = std::move(*pending_);
+            pending_.reset();
+            lock.unlock();
+            std::optional<saved> s;
+            std::optional<std::string> err;
+            try {
+                s = save(std::move(snap));
+            } catch(const std::exception &e) {
+                err = e.what();
+            }
+            lock.lock();
+            if(s)
+                saved_ = std::move(s);
+            if(err)
+                error_ = std::move(err);
+        }
+    }
+
+    auto save(snapshot &&snap)->std::optional<saved>
+    {
+        pwdb::lock_overwrite_file db_file_lock{db_file_, lock_wait};
+        if(pwdb::get_file_generation(db_file_) != snap.gen)
+            return std::nullopt;
+        pwdb::db sdb{std::move(snap.pb)};
+        std::lock_guard own_lock{own_.mtx};
+        checkpoint_pwdb(db_file_lock, sdb, gpg_homedir_, &cache_);
+        // Still locked, so this is the generation of the file just saved
+        own_.last = pwdb::get_file_generation(db_file_);
+        return saved{own_.last, sdb.pb()};
+    }
+
+    std::string db_file_;
+    std::string gpg_homedir_;
+    clock::duration delay_;
+    pwdb::chunk_cache cache_;   // used only by the thread until stopped
+    own_saves &own_;
+    std::mutex mtx_;
+    std::condition_variable_any cv_;
+    std::optional<snapshot> pending_;
+    std::optional<saved> saved_;
+    std::optional<std::string> error_;
+    std::jthread thread_;   // last, so stopped before the above are destroyed
+};
+
+static void
+report_merge(const pwdb::merge_result &res)
+{
+    for(const auto &name: res.conflicts) {
+        std::cerr << "WARNING: Record " << name << " changed by both, "
+            "review it and any " << name << pwdb::conflict_suffix <<
+            std::endl;
+    }
+    if(!res.changed.empty()) {
+        std::cerr << res.changed.size() << " record(s) updated" << std::endl;
+    }
+}
+
+// Merge theirs, a newer version of the database, into cdb given their common
+// base, then make theirs the new base. Returns true if cdb now differs from
+// theirs only because of conflicts.
+static bool
+merge_newer(pwdb::db &cdb, pwdb::pb::DB &base, pwdb::pb::DB &&theirs)
+{
+    auto res = pwdb::db_merge3(cdb, base, theirs);
+    report_merge(res);
+    base = std::move(theirs);
+    return !res.conflicts.empty();
 }
 
 static void
 subcmd_open(const pwdb::cl_options &opts)
 {
-    pwdb::lock_overwrite_file db_file_lock{fs::path(opts.pwdb_file)};
-    auto db_file = db_file_lock.file().string();
-    bool db_file_exists = fs::exists(db_file);
-    std::cerr << (db_file_exists ? "Opening " : "Creating ") << db_file <<
+    // The session runs without the lock; it is taken only to save, merging in
+    // any changes saved by others since the file generation read here.
+    const auto format = pwdb::parse_output_format(opts.output);
+    // Kept apart from machine readable output
+    auto &status = format == pwdb::output_format::text ? std::cout : std::cerr;
+    auto db_file = fs::weakly_canonical(opts.pwdb_file).string();
+    auto db_gen = pwdb::get_file_generation(db_file);
+    if(opts.read_only && !db_gen.exists) {
+        throw std::runtime_error("File does not exist: "s + db_file);
+    }
+    std::cerr << (db_gen.exists ? "Opening " : "Creating ") << db_file <<
         std::endl;
     pwdb::db cdb{};
-    if(db_file_exists) {
-        read_from_pwdb(cdb, db_file, opts.gpg_homedir);
+    pwdb::chunk_cache cache;
+    if(db_gen.exists) {
+        // Read the file in while gpgme initializes and checks the engine
+        auto data = std::async(std::launch::async, read_whole_file, db_file);
+        gpgh::context ctx{opts.gpg_homedir};
+        auto bytes = data.get();
+        std::ispanstream in{std::span<char>{bytes}};
+        auto vdb = pwdb::read_db(ctx, in, &cache);
+        check_gpg_verify_result(vdb.sigs, status);
+        cdb = std::move(vdb.pb);
+    }
+    auto base = cdb.pb();
+    // Digest of base, computed when first needed after base changes
+    std::optional<pwdb::sha256::digest> base_digest;
+    bool cdb_modified = false;
+
+    // The uid key is checked in the background once the uid is known, the
+    // prompt showing meanwhile, and any re-pinning applied before the first
+    // command runs
+    std::future<uid_check_result> uid_check;
+    auto finish_uid_check = [&cdb, &uid_check]() {
+        if(!uid_check.valid())
+            return;
+        auto res = uid_check.get();
+        if(res.warning)
+            std::cerr << *res.warning << std::flush;
+        if(!res.pins.empty() && res.pins != cdb.key_pin(cdb.uid()))
+            cdb.key_pin(cdb.uid(), res.pins);
+    };
+    auto uid_checked = [&uid_check]() {
+        return uid_check.valid() && uid_check.wait_for(
+                std::chrono::seconds{0}) == std::future_status::ready;
+    };
+
+    // Merge in new versions of the file saved while the session is open. Done
+    // at the top level prompt, never with a record store open.
+    own_saves own;
+    std::optional<db_reloader> reloader;
+    if(db_gen.exists) {
+        reloader.emplace(db_file, opts.gpg_homedir, db_gen, own);
+    }
+    // Save changes in the background once edits pause, from a snapshot taken
+    // as each top level command is read, and make each version saved the new
+    // base. The final save is then left with little or nothing to do.
+    std::optional<db_autosaver> autosaver;
+    const pwdb::pwdb_cmd_interp *interp = nullptr;
+    std::optional<pwdb::sha256::digest> autosave_submitted;
+    bool autosaved = false;
+    auto take_autosaved = [&]() {
+        if(!autosaver)
+            return;
+        if(auto err = autosaver->take_error()) {
+            std::cerr << "WARNING: Autosaving " << db_file << ": " << *err <<
+                std::endl;
+            autosave_submitted.reset();
+        }
+        if(auto s = autosaver->take()) {
+            base = std::move(s->pb);
+            base_digest.reset();
+            db_gen = s->gen;
+            autosaved = true;
+        }
+    };
+    auto submit_autosave = [&]() {
+        if(!autosaver || !(cdb_modified || (interp && interp->modified())))
+            return;
+        auto digest = pwdb::db_digest(cdb.pb());
+        if(!base_digest)
+            base_digest = pwdb::db_digest(base);
+        if(digest == autosave_submitted || digest == base_digest)
+            return;
+        autosaver->submit(cdb.pb(), db_gen);
+        autosave_submitted = digest;
+    };
+
+    auto merge_reloaded = [&]() {
+        if(auto err = reloader->take_error()) {
+            std::cerr << "WARNING: Reloading " << db_file << ": " << *err <<
+                std::endl;
+        }
+        // Taken first, so a version autosaved meanwhile is known as ours
+        take_autosaved();
+        if(auto newer = reloader->take(); newer && newer->gen != db_gen) {
+            std::cerr << "Database changed on disk, merging" << std::endl;
+            check_gpg_verify_result(newer->vdb.sigs, status);
+            if(merge_newer(cdb, base, std::move(newer->vdb.pb)))
+                cdb_modified = true;
+            base_digest.reset();
+            db_gen = newer->gen;
+            cache.merge(std::move(newer->cache));
+            // A snapshot submitted before is dropped for the file changing
+            autosave_submitted.reset();
+        }
+    };
+
+    const std::string prompt = opts.read_only ? "pwdb(ro)> " : "pwdb> ";
+    cmd_interp::output::paging(opts.pager);
+    bool at_prompt = false;
+    // Commands are read without prompts when standard input is not a terminal,
+    // so scripts can run a batch of them
+    auto ops = isatty(STDIN_FILENO) ? cmd_interp::readline_ops() :
+        cmd_interp::istream_ops(std::cin, false);
+    ops.get = [&, get = ops.get](const std::string &p) {
+        if(p == prompt) {
+            take_autosaved();
+            submit_autosave();
+        }
+        at_prompt = p == prompt;
+        auto line = get(p);
+        at_prompt = false;
+        if(p != prompt)
+            return line;
+        finish_uid_check();
+        if(reloader)
+            merge_reloaded();
+        return line;
+    };
+    // While waiting at the prompt too, not only once a command is entered
+    if(ops.add_timer) {
+        ops.add_timer(reload_interval, [&]() {
+            if(at_prompt && uid_checked())
+                cmd_interp::print_above_input(finish_uid_check);
+            if(at_prompt && reloader && reloader->pending())
+                cmd_interp::print_above_input(merge_reloaded);
+        });
+    }
+
+    if(opts.read_only) {
+        // Nothing is saved, so no lock, signer, or uid checks are needed
+        pwdb::pwdb_cmd_interp cmd_interp(cdb, ops, true);
+        cmd_interp.prefetch(opts.prefetch);
+        cmd_interp.format(format);
+        cmd_interp.run(prompt);
+        std::cerr << "Closed " << db_file << std::endl;
+        return;
     }
 
     // Set signing and primary encryption uid
-    bool cdb_modified = false;
     if(!opts.uid.empty() && opts.uid != cdb.uid()) {
         if(!cdb.uid().empty()) {
             std::cerr <<
@@ -101,25 +594,44 @@ subcmd_open(const pwdb::cl_options &opts)
         cdb.uid(opts.uid);
         cdb_modified = true;
     }
-    {
-        gpgh::context ctx{opts.gpg_homedir};
-        check_uid(ctx, cdb.uid());
+    uid_check = check_uid_async(cdb, opts.gpg_homedir);
+    if(opts.autosave) {
+        autosaver.emplace(db_file, opts.gpg_homedir, autosave_delay,
+                pwdb::chunk_cache{cache}, own);
     }
 
     // Run command interpreter
-    pwdb::pwdb_cmd_interp cmd_interp(cdb);
-    cmd_interp.run("pwdb> ");
+    pwdb::pwdb_cmd_interp cmd_interp(cdb, ops);
+    interp = &cmd_interp;
+    cmd_interp.prefetch(opts.prefetch);
+    cmd_interp.format(format);
+    cmd_interp.run(prompt);
+    finish_uid_check();
     cdb_modified = cdb_modified || cmd_interp.modified();
+    interp = nullptr;
+    reloader.reset();
+    if(autosaver) {
+        cache.merge(autosaver->stop());
+        take_autosaved();
+    }
 
     // Save database
     if(cdb_modified) {
-        std::cerr << "Database modified, saving" << std::endl;
-        auto encode = [&cdb, &opts](std::ostream& out) {
-            gpgh::context ctx{opts.gpg_homedir};
-            ctx.add_signer(cdb.uid());
-            pwdb::encode_data(ctx, cdb.uid(), cdb.pb(), out, true);
-        };
-        db_file_lock.overwrite(encode);
+        pwdb::lock_overwrite_file db_file_lock{db_file, lock_wait};
+        if(pwdb::get_file_generation(db_file) != db_gen) {
+            std::cerr << "Database changed since opened, merging" << std::endl;
+            pwdb::db theirs{};
+            read_from_pwdb(theirs, db_file, opts.gpg_homedir, &cache);
+            merge_newer(cdb, base, pwdb::pb::DB{theirs.pb()});
+        }
+        // Changes may have been undone, or made the same by others
+        if(pwdb::db_digest(cdb.pb()) == pwdb::db_digest(base)) {
+            std::cerr << (autosaved ? "Database saved" :
+                    "Database unchanged, not saving") << std::endl;
+        } else {
+            std::cerr << "Database modified, saving" << std::endl;
+            save_to_pwdb(db_file_lock, cdb, opts.gpg_homedir, &cache);
+        }
     }
     std::cerr << "Closed " << db_file << std::endl;
 }
@@ -136,24 +648,69 @@ subcmd_recrypt(const pwdb::cl_options &opts)
     std::cerr << "Re-encrypting " << db_file << std::endl;
     pwdb::db cdb{};
     read_from_pwdb(cdb, db_file, opts.gpg_homedir);
+    // Only chunks encrypted by this run are reused. The file read may be
+    // encrypted to keys recrypt is replacing, even for the same uid.
+    pwdb::chunk_cache cache;
 
-    // Set signing and primary encryption uid then re-encrypt
+    // Set signing and primary encryption uid
     if(!opts.uid.empty()) {
         cdb.uid(opts.uid);
     }
-    {
-        gpgh::context ctx{opts.gpg_homedir};
-        check_uid(ctx, cdb.uid());
-        pwdb::db_recrypt_rcd_stores(ctx, cdb);
-    }
+    gpgh::context ctx{opts.gpg_homedir};
+    check_uid(ctx, cdb);
 
-    // Save database
-    auto encode = [&cdb, &opts](std::ostream& out) {
-        gpgh::context ctx{opts.gpg_homedir};
-        ctx.add_signer(cdb.uid());
-        pwdb::encode_data(ctx, cdb.uid(), cdb.pb(), out, true);
+    // Re-encrypt with progress reports, saving every checkpoint_interval and
+    // when stopped by SIGINT or an error. Records saved as encrypted to the
+    // uid are skipped when run again, so an interrupted recrypt resumes.
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    auto last_report = start;
+    auto last_checkpoint = start;
+    size_t checked = 0;
+    pwdb::interrupt_guard interrupt;
+    auto progress = [&](size_t done, size_t total) {
+        checked = done;
+        const auto now = clock::now();
+        if(now - last_report >= std::chrono::seconds{1} || done == total) {
+            last_report = now;
+            const std::chrono::duration<double> elapsed = now - start;
+            const double rate = elapsed.count() > 0 ?
+                done / elapsed.count() : 0;
+            const auto eta = rate > 0 ?
+                static_cast<unsigned long>((total - done) / rate) : 0;
+            std::cerr << std::format("\r{}/{} records, {:.1f} records/s, "
+                    "ETA {}:{:02}   ", done, total, rate, eta / 60, eta % 60) <<
+                std::flush;
+        }
+        if(now - last_checkpoint >= checkpoint_interval) {
+            checkpoint_pwdb(db_file_lock, cdb, opts.gpg_homedir, &cache);
+            last_checkpoint = clock::now();
+        }
+        return !interrupt.interrupted();
     };
-    db_file_lock.overwrite(encode);
+    size_t count = 0;
+    std::exception_ptr error;
+    try {
+        count = pwdb::db_recrypt_rcd_stores(ctx, cdb, progress);
+    } catch(...) {
+        // gpg is also sent SIGINT, so an interrupt may show as an error
+        if(!interrupt.interrupted())
+            error = std::current_exception();
+    }
+    if(checked != 0)
+        std::cerr << std::endl;
+    if(error || interrupt.interrupted()) {
+        std::cerr << std::format("Stopped after checking {} record(s), run "
+                "recrypt again to resume", checked) << std::endl;
+    } else {
+        std::cerr << std::format("Re-encrypted {} of {} record(s)", count,
+                cdb.size()) << std::endl;
+    }
+
+    // Save database, with any progress made before an error
+    save_to_pwdb(db_file_lock, cdb, opts.gpg_homedir, &cache);
+    if(error)
+        std::rethrow_exception(error);
 }
 
 static void
@@ -170,8 +727,10 @@ subcmd_import(const pwdb::cl_options &opts)
         std::ifstream ifs(opts.infile, std::ios::in | std::ios::binary);
         ifs.exceptions(std::ios::badbit | std::ios::failbit);
         gpgh::context ctx{opts.gpg_homedir};
-        cdb = pwdb::json2pb<pwdb::pb::DB>(ctx.decrypt(ifs));
+        auto json = ctx.decrypt(ifs);
         check_gpg_verify_result(ctx);
+        cdb = pwdb::is_ndjson(json) ? pwdb::ndjson2pb<pwdb::pb::DB>(json) :
+            pwdb::json2pb<pwdb::pb::DB>(json);
     }
 
     // Set signing and primary encryption uid, then encrypt record stores
@@ -180,17 +739,12 @@ subcmd_import(const pwdb::cl_options &opts)
     }
     {
         gpgh::context ctx{opts.gpg_homedir};
-        check_uid(ctx, cdb.uid());
+        check_uid(ctx, cdb);
         pwdb::db_recrypt_rcd_stores(ctx, cdb);
     }
 
     // Save database
-    auto encode = [&cdb, &opts](std::ostream& out) {
-        gpgh::context ctx{opts.gpg_homedir};
-        ctx.add_signer(cdb.uid());
-        pwdb::encode_data(ctx, cdb.uid(), cdb.pb(), out, true);
-    };
-    db_file_lock.overwrite(encode);
+    save_to_pwdb(db_file_lock, cdb, opts.gpg_homedir);
 }
 
 static void
@@ -211,31 +765,205 @@ subcmd_export(const pwdb::cl_options &opts)
     }
     {
         gpgh::context ctx{opts.gpg_homedir};
-        check_uid(ctx, cdb.uid());
+        check_uid(ctx, cdb);
     }
 
-    // Export
+    // Export as NDJSON: a uid line, one line per record with its store
+    // decrypted, then one line per tag. Lines are generated as gpg consumes
+    // them so only one decrypted record is held in memory at a time, which is
+    // why they are decrypted one by one rather than on a gpgh::event_loop.
     std::ofstream ofs(opts.outfile,
             std::ios::out | std::ios::binary);
     ofs.exceptions(std::ios::badbit | std::ios::failbit);
     fs::permissions(opts.outfile,
             fs::perms::owner_read | fs::perms::owner_write);
     gpgh::context ctx{opts.gpg_homedir};
-    ctx.add_signer(cdb.uid());
-    db_decrypt_all_rcd_stores(ctx, cdb);
-    auto json = pwdb::pb2json(cdb.get_db());
-    auto keyfilt = [](gpgme_key_t k)->bool {
-        return !k->revoked && !k->expired && k->can_encrypt &&
-            k->can_sign;
+    auto keys = pwdb::db_add_signer(ctx, cdb);
+    gpgh::context dec_ctx{opts.gpg_homedir};
+    pwdb::generator_streambuf json_sbuf{
+        [next = pwdb::db_decrypted_fragments(dec_ctx, cdb)]()->
+            std::optional<std::string> {
+            auto frag = next();
+            if(!frag)
+                return std::nullopt;
+            return pwdb::pb2json_line(*frag);
+        }
     };
-    auto keys = ctx.get_keys(cdb.uid(), false, keyfilt);
-    ctx.encrypt(keys, json, ofs, true);
+    std::istream json_strm{&json_sbuf};
+    ctx.encrypt(keys, json_strm, ofs, true);
 }
 
+static void
+subcmd_backup(const pwdb::cl_options &opts)
+{
+    // Because writers use read-write-replace readers shouldn't need to lock
+    auto db_file = fs::weakly_canonical(opts.pwdb_file).string();
+    if(!fs::exists(db_file)) {
+        throw std::runtime_error("File does not exist: "s + db_file);
+    }
+    std::cerr << "Backing up " << db_file << " to " << opts.outfile <<
+        std::endl;
+    pwdb::db cdb{};
+    read_from_pwdb(cdb, db_file, opts.gpg_homedir);
+
+    // Set signing and primary encryption uid
+    if(!opts.uid.empty()) {
+        cdb.uid(opts.uid);
+    }
+    {
+        gpgh::context ctx{opts.gpg_homedir};
+        check_uid(ctx, cdb);
+    }
+
+    // Backup as a length delimited stream of partial pb::DB messages, the
+    // same sequence export writes as JSON lines.
+    std::ofstream ofs(opts.outfile,
+            std::ios::out | std::ios::binary);
+    ofs.exceptions(std::ios::badbit | std::ios::failbit);
+    fs::permissions(opts.outfile,
+            fs::perms::owner_read | fs::perms::owner_write);
+    gpgh::context ctx{opts.gpg_homedir};
+    auto keys = pwdb::db_add_signer(ctx, cdb);
+    gpgh::context dec_ctx{opts.gpg_homedir};
+    pwdb::encode_delimited<pwdb::pb::DB>(ctx, keys,
+            pwdb::db_decrypted_fragments(dec_ctx, cdb), ofs, true);
+}
+
+static void
+subcmd_restore(const pwdb::cl_options &opts)
+{
+    pwdb::lock_overwrite_file db_file_lock{fs::path(opts.pwdb_file)};
+    auto db_file = db_file_lock.file().string();
+    if(fs::exists(db_file)) {
+        throw std::runtime_error("File exists: "s + db_file);
+    }
+    std::cerr << "Restoring " << opts.infile << " to " << db_file << std::endl;
+    pwdb::pb::DB pb_db;
+    {
+        std::ifstream ifs(opts.infile, std::ios::in | std::ios::binary);
+        ifs.exceptions(std::ios::badbit | std::ios::failbit);
+        gpgh::context ctx{opts.gpg_homedir};
+        pwdb::decode_delimited<pwdb::pb::DB>(ctx, ifs,
+                [&pb_db](pwdb::pb::DB &&frag) { pb_db.MergeFrom(frag); });
+        check_gpg_verify_result(ctx);
+    }
+    pwdb::db cdb{std::move(pb_db)};
+
+    // Set signing and primary encryption uid, then encrypt record stores
+    if(!opts.uid.empty()) {
+        cdb.uid(opts.uid);
+    }
+    {
+        gpgh::context ctx{opts.gpg_homedir};
+        check_uid(ctx, cdb);
+        pwdb::db_recrypt_rcd_stores(ctx, cdb);
+    }
+
+    // Save database
+    save_to_pwdb(db_file_lock, cdb, opts.gpg_homedir);
+}
+
+static void
+subcmd_merge(const pwdb::cl_options &opts)
+{
+    const std::map<std::string, pwdb::merge_policy> policies{
+        {"ours", pwdb::merge_policy::ours},
+        {"theirs", pwdb::merge_policy::theirs},
+        {"both", pwdb::merge_policy::both},
+    };
+    auto policy_iter = policies.find(opts.merge_policy);
+    if(policy_iter == policies.end()) {
+        throw std::runtime_error("Invalid merge policy: "s +
+                opts.merge_policy);
+    }
+
+    // Lock, check, and read in both pwdb files
+    pwdb::lock_overwrite_file db_file_lock{fs::path(opts.pwdb_file)};
+    auto db_file = db_file_lock.file().string();
+    for(const auto &file: {db_file, opts.infile}) {
+        if(!fs::exists(file)) {
+            throw std::runtime_error("File does not exist: "s + file);
+        }
+    }
+    std::cerr << "Merging " << opts.infile << " into " << db_file << std::endl;
+    pwdb::db cdb{};
+    pwdb::chunk_cache cache;
+    read_from_pwdb(cdb, db_file, opts.gpg_homedir, &cache);
+    pwdb::db theirs{};
+    read_from_pwdb(theirs, opts.infile, opts.gpg_homedir);
+
+    // Stores are decrypted only for records whose content hashes differ
+    gpgh::context ctx{opts.gpg_homedir};
+    auto same_store = [&ctx](const pwdb::pb::Record &o,
+            const pwdb::pb::Record &t) {
+        return gpu::MessageDifferencer::Equals(
+                pwdb::db_open_rcd_store(ctx, o),
+                pwdb::db_open_rcd_store(ctx, t));
+    };
+    auto res = pwdb::db_merge(cdb, theirs.pb(), policy_iter->second,
+            same_store);
+    report_merge(res);
+    if(res.changed.empty()) {
+        std::cerr << "Nothing to merge" << std::endl;
+        return;
+    }
+
+    // Save database
+    save_to_pwdb(db_file_lock, cdb, opts.gpg_homedir, &cache);
+}
+
+static void
+subcmd_diff(const pwdb::cl_options &opts)
+{
+    auto db_file = fs::weakly_canonical(opts.pwdb_file).string();
+    for(const auto &file: {db_file, opts.infile}) {
+        if(!file.empty() && !fs::exists(file)) {
+            throw std::runtime_error("File does not exist: "s + file);
+        }
+    }
+    pwdb::db cdb{};
+    read_from_pwdb(cdb, db_file, opts.gpg_homedir);
+    if(opts.infile.empty()) {
+        std::cout << pwdb::merkle_root(cdb.pb()) << std::endl;
+        return;
+    }
+    pwdb::db theirs{};
+    read_from_pwdb(theirs, opts.infile, opts.gpg_homedir);
+    auto diff = pwdb::merkle_diff(cdb.pb(), theirs.pb());
+    for(const auto &name: diff.added)
+        std::cout << "+ " << name << '\n';
+    for(const auto &name: diff.removed)
+        std::cout << "- " << name << '\n';
+    for(const auto &name: diff.changed)
+        std::cout << "~ " << name << '\n';
+    std::cout << std::flush;
+}
+
+// Print the latency histograms of the run to stderr, when asked for
+struct latency_report
+{
+    bool enabled{false};
+    ~latency_report()
+    {
+        if(!enabled)
+            return;
+        std::string out;
+        // Only open runs commands
+        if(!pwdb::command_latency().empty())
+            pwdb::print_latency(out, "commands", pwdb::command_latency());
+        pwdb::print_latency(out, "gpg operations", pwdb::gpg_latency());
+        std::cerr << out << std::flush;
+    }
+};
+
 int main(int argc, const char *argv[])
 {
+    pwdb::time_gpg_ops();
+    pwdb::trace_session trace;
+    latency_report report;
     try {
         const auto opts = pwdb::cl_handle(argc, argv);
+        report.enabled = opts.stats;
         if(opts.help)
             std::cout << opts.usage_msg << std::endl;
         else if(opts.version)
@@ -248,6 +976,14 @@ int main(int argc, const char *argv[])
             subcmd_import(opts);
         else if(opts.subcmd == "export")
             subcmd_export(opts);
+        else if(opts.subcmd == "backup")
+            subcmd_backup(opts);
+        else if(opts.subcmd == "restore")
+            subcmd_restore(opts);
+        else if(opts.subcmd == "merge")
+            subcmd_merge(opts);
+        else if(opts.subcmd == "diff")
+            subcmd_diff(opts);
         else
             throw std::logic_error("Invalid commandline options structure");
     } catch(const std::runtime_error &e) {
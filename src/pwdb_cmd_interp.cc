@@ -23,12 +23,37 @@
 #include "pwdb/pb_json.h"
 #include "pwdb/util.h"
 #include "pwdb/db_utils.h"
+#include "pwdb/db_merge.h"
+#include "pwdb/latency.h"
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <deque>
 #include <array>
+#include <optional>
+#include <stdexcept>
+#include <unistd.h>
 
 namespace pwdb {
 
+using cmd_handle_t = std::function<cmd_interp::interp::result_t(
+        const std::vector<std::string> &)>;
+
+// Wrap the handler of a command that modifies the database to reject it when
+// read_only is set
+static cmd_handle_t
+mutating(const bool &read_only, cmd_handle_t handle)
+{
+    return [&read_only, handle](const std::vector<std::string> &args) {
+        if(read_only) {
+            std::cerr << args.at(0) << ": Not permitted, opened read-only" <<
+                std::endl;
+            return cmd_interp::interp::result_add_history;
+        }
+        return handle(args);
+    };
+}
+
 //-----------------------------------------------------------------------------
 // pwdb_cmd_interp
 //-----------------------------------------------------------------------------
@@ -52,12 +77,14 @@ def_interp(const cmd_interp::ops &ops)
     };
     d["list"] = { "([<TAG>]) Lists records optionally filtered by <TAG>",
         [this](A &args)->interp::result_t {
-            if(cdb_.size() == 0)
+            if(cdb_.size() == 0) {
+                list_records({});
                 return interp::result_add_history;
-            std::deque<std::array<std::string, 2>> das{};
+            }
+            std::vector<std::string> shown;
             if(args.size() == 1) {
                 for(const auto &entry: cdb_)
-                    das.push_back({entry.first, entry.second.comment()});
+                    shown.push_back(entry.first);
             }
             else {
                 auto names = cdb_.at_tag(args[1]);
@@ -71,17 +98,40 @@ def_interp(const cmd_interp::ops &ops)
                             args[1] << " record: " << n << std::endl;
                         continue;
                     }
-                    das.push_back({n, cdb_.at(n).comment()});
+                    shown.push_back(n);
                 }
             }
-            std::sort(das.begin(), das.end());
-            cmd_interp::print_columns(std::cout, das.cbegin(), das.cend(),
-                    "  ", "  ");
+            list_records(std::move(shown));
             return interp::result_add_history;
         }
     };
-    d["add"] = { "(<NAME> [COMMENT]) Add new record NAME and set COMMENT",
+    d["find"] = { "(<TEXT>) Lists records whose name or comment contains "
+        "<TEXT>, ignoring case",
         [this](A &args)->interp::result_t {
+            if(args.size() < 2) {
+                std::cerr << "Missing required argumant <TEXT>" << std::endl;
+                interp_.help(std::cerr, args.at(0));
+                return interp::result_add_history;
+            }
+            auto lower = [](std::string s) {
+                std::transform(s.begin(), s.end(), s.begin(),
+                        [](unsigned char c) { return std::tolower(c); });
+                return s;
+            };
+            const auto text = lower(cmd_interp::assemble(args.begin()+1,
+                        args.end()));
+            std::vector<std::string> shown;
+            for(const auto &[name, rcd]: cdb_) {
+                if(lower(name).find(text) != std::string::npos ||
+                        lower(rcd.comment()).find(text) != std::string::npos)
+                    shown.push_back(name);
+            }
+            list_records(std::move(shown));
+            return interp::result_add_history;
+        }
+    };
+    d["add"] = { "(<NAME> [COMMENT]) Add new record NAME and set COMMENT",
+        mutating(read_only_, [this](A &args)->interp::result_t {
             if(args.size() < 2) {
                 std::cerr << "Missing required argument" << std::endl;
                 interp_.help(std::cerr, args.at(0));
@@ -98,22 +148,23 @@ def_interp(const cmd_interp::ops &ops)
             cdb_.add(rcd_name, std::move(rcd));
             modified_ = true;
             return interp::result_add_history;
-        }
+        })
     };
     d["remove"] = { "(<NAME>) Remove record NAME",
-        [this](A &args)->interp::result_t {
+        mutating(read_only_, [this](A &args)->interp::result_t {
             if(args.size() != 2) {
                 std::cerr << "Incorrect number of arguments" << std::endl;
                 interp_.help(std::cerr, args.at(0));
                 return interp::result_add_history;
             }
             if(cdb_.remove(args.at(1))) {
+                cache_.erase(args.at(1));
                 modified_ = true;
             } else {
                 std::cerr << "No such record" << std::endl;
             }
             return interp::result_add_history;
-        }
+        })
     };
     d["open"] = { "(<NAME>) Open the data store of record NAME",
         [this](A &args)->interp::result_t {
@@ -128,27 +179,67 @@ def_interp(const cmd_interp::ops &ops)
                 std::cerr << "No such record" << std::endl;
                 return interp::result_add_history;
             }
+            if(prefetch_)
+                prefetch_->wait(name);
             gpgh::context ctx{};
-            rcd_cmd_interp rcd_interp{db_open_rcd_store(ctx, rcd_iter->second),
-                interp_.ops()};
+            // The keys are resolved only if the store is saved, so a record
+            // shared with someone whose key is missing still opens
+            sha256::digest digest{};
+            std::vector<std::string> keyids;
+            pb::Store store;
+            try {
+                store = read_only_ ?
+                    db_open_rcd_store(ctx, name, rcd_iter->second, cache_) :
+                    db_open_rcd_store(ctx, name, rcd_iter->second, digest,
+                            keyids, cache_);
+            } catch(const std::runtime_error &e) {
+                std::cerr << "Failed to open " << name << ": " << e.what() <<
+                    std::endl;
+                return interp::result_add_history;
+            }
+            rcd_cmd_interp rcd_interp{store, interp_.ops(), read_only_};
+            rcd_interp.format(format_);
+            // Kept apart from machine readable output
+            auto &status = format_ == output_format::text ? std::cout :
+                std::cerr;
             {
-                // Use alternate terminal buffer when record is open
-                pwdb::term_mode tmode{};
+                // Use alternate terminal buffer when record is open, but
+                // keep its escapes out of piped and machine readable output
+                std::optional<pwdb::term_mode> tmode;
+                if(format_ == output_format::text && isatty(STDOUT_FILENO)) {
+                    try {
+                        tmode.emplace();
+                    } catch(const std::runtime_error &) {
+                        // No terminfo, e.g. TERM unset, so stay in place
+                    }
+                }
                 rcd_interp.print();
                 rcd_interp.run(name + "> ");
             }
+            bool saved = false;
             if(rcd_interp.modified()) {
-                std::cout << "Encrypting and closing " << name << std::endl;
-                db_save_rcd_store(ctx, cdb_, name, rcd_interp.store());
+                try {
+                    auto keys = db_rcd_keys(ctx, cdb_, cdb_.at(name));
+                    saved = db_save_rcd_store(ctx, cdb_, name,
+                            rcd_interp.store(), keys, digest, keyids);
+                } catch(const std::exception &e) {
+                    std::cerr << "Changes to " << name << " not saved: " <<
+                        e.what() << std::endl;
+                    return interp::result_add_history;
+                }
+            }
+            if(saved) {
+                status << "Encrypted and closing " << name << std::endl;
+                cache_.erase(name);
                 modified_ = true;
             } else {
-                std::cout << "No modification, closing " << name << std::endl;
+                status << "No modification, closing " << name << std::endl;
             }
             return interp::result_add_history;
         }
     };
     d["comment"] = { "(<NAME> [<COMMENT>]) Set COMMENT of record NAME",
-        [this](A &args)->interp::result_t {
+        mutating(read_only_, [this](A &args)->interp::result_t {
             if(args.size() < 2) {
                 std::cerr << "Missing required argumant <NAME>" << std::endl;
                 interp_.help(std::cerr, args.at(0));
@@ -162,10 +253,63 @@ def_interp(const cmd_interp::ops &ops)
                 std::cerr << "No such record" << std::endl;
             }
             return interp::result_add_history;
-        }
+        })
+    };
+    d["recipients"] = { "(<NAME> [<UID>]...) Set additional encryption "
+        "recipients of record NAME",
+        mutating(read_only_, [this](A &args)->interp::result_t {
+            if(args.size() < 2) {
+                std::cerr << "Missing required argumant <NAME>" << std::endl;
+                interp_.help(std::cerr, args.at(0));
+                return interp::result_add_history;
+            }
+            const auto &name = args[1];
+            auto rcd_iter = cdb_.find(name);
+            if(cdb_.end() == rcd_iter) {
+                std::cerr << "No such record" << std::endl;
+                return interp::result_add_history;
+            }
+            pb::Record updated = rcd_iter->second;
+            updated.clear_recipient();
+            for(auto i = args.begin() + 2; i != args.end(); ++i) {
+                if(*i != cdb_.uid() && std::find(updated.recipient().begin(),
+                            updated.recipient().end(), *i) ==
+                        updated.recipient().end())
+                    updated.add_recipient(*i);
+            }
+            if(same_record(updated, rcd_iter->second))
+                return interp::result_add_history;
+            // Find the keys before changing anything, then re-encrypt
+            gpgh::context ctx{};
+            gpgh::keylist keys;
+            try {
+                keys = db_rcd_keys(ctx, cdb_, updated);
+            } catch(const std::runtime_error &e) {
+                std::cerr << e.what() << std::endl;
+                return interp::result_add_history;
+            }
+            const bool has_payload = rcd_iter->second.has_store() ||
+                !rcd_iter->second.data().empty();
+            pb::Store store;
+            try {
+                store = db_open_rcd_store(ctx, name, rcd_iter->second,
+                        cache_);
+            } catch(const std::runtime_error &e) {
+                std::cerr << "Failed to open " << name << ": " << e.what() <<
+                    std::endl;
+                return interp::result_add_history;
+            }
+            cdb_.recipients(name, {updated.recipient().begin(),
+                    updated.recipient().end()});
+            if(has_payload)
+                db_save_rcd_store(ctx, cdb_, name, store, keys);
+            cache_.erase(name);
+            modified_ = true;
+            return interp::result_add_history;
+        })
     };
     d["tag"] = { "(<NAME> <TAG>) Tag record <NAME> with <TAG>",
-        [this](A &args)->interp::result_t {
+        mutating(read_only_, [this](A &args)->interp::result_t {
             if(args.size() != 3) {
                 std::cerr << "Incorrect number of arguments" << std::endl;
                 interp_.help(std::cerr, args.at(0));
@@ -177,10 +321,10 @@ def_interp(const cmd_interp::ops &ops)
                 std::cerr << "No such record" << std::endl;
             }
             return interp::result_add_history;
-        }
+        })
     };
     d["detag"] = { "(<NAME> <TAG>) Remove <TAG> from record <NAME>",
-        [this](A &args)->interp::result_t {
+        mutating(read_only_, [this](A &args)->interp::result_t {
             if(args.size() != 3) {
                 std::cerr << "Incorrect number of arguments" << std::endl;
                 interp_.help(std::cerr, args.at(0));
@@ -192,7 +336,7 @@ def_interp(const cmd_interp::ops &ops)
                 std::cerr << "No such record" << std::endl;
             }
             return interp::result_add_history;
-        }
+        })
     };
     d["tags"] = { "Print all known tags",
         [this](A &args)->interp::result_t {
@@ -201,46 +345,152 @@ def_interp(const cmd_interp::ops &ops)
                 interp_.help(std::cerr, args.at(0));
                 return interp::result_add_history;
             }
+            cmd_interp::output out;
             auto tags = cdb_.tags();
+            if(format_ != output_format::text) {
+                row_writer rows{out.buffer(), format_, {"tag"}};
+                for(const auto &t: tags)
+                    rows.row({t});
+                return interp::result_add_history;
+            }
             for(auto ti = tags.begin(); ti != tags.end(); ++ti) {
                 if(ti != tags.begin())
-                    std::cout << ", ";
-                std::cout << *ti;
+                    out.buffer() += ", ";
+                out.buffer() += *ti;
             }
-            std::cout << std::endl;
+            out.buffer() += '\n';
             return interp::result_add_history;
         }};
+    d["stats"] = { "Print session statistics and latency histograms",
+        [this](A &args)->interp::result_t {
+            cache_.expire();
+            const auto st = cache_.stats();
+            cmd_interp::output out;
+            out.print("store cache: {} entries, {} bytes, {} hits, {} misses, "
+                    "{} evicted, {} expired", st.entries, st.bytes, st.hits,
+                    st.misses, st.evictions, st.expirations);
+            if(st.unlocked != 0)
+                out.print(", {} not locked in memory", st.unlocked);
+            out.print("\n");
+            print_latency(out.buffer(), "commands", command_latency());
+            print_latency(out.buffer(), "gpg operations", gpg_latency());
+            return interp::result_add_history;
+        }
+    };
     d["dump"] = { "([<NAME> ...] Dump database or records to terminal",
         [this](A &args)->interp::result_t {
+            cmd_interp::output out;
+            if(format_ != output_format::text) {
+                write_dump(out.buffer(), format_, cdb_,
+                        {args.begin() + 1, args.end()});
+                return interp::result_add_history;
+            }
             if(args.size() == 1) {
-                cdb_.stream_out(std::cout, 4);
+                cdb_.stream_out(out.buffer(), 4);
                 return interp::result_add_history;
             }
             for(size_t i = 1; i < args.size(); ++i) {
                 constexpr unsigned indent = 4;
-                std::string prefix(indent, ' ');
-                auto rcd_name = args.at(i);
-                std::cout << prefix << rcd_name << ": ";
+                const auto &rcd_name = args.at(i);
+                out.print("{:{}}{}: ", "", indent, rcd_name);
                 if(cdb_.count(rcd_name) == 0)
-                    std::cout << "NULL" << std::endl;
+                    out.print("NULL\n");
                 else {
-                    std::cout << "{\n";
-                    stream_out(cdb_.at(rcd_name), std::cout, indent+4);
-                    std::cout << prefix << "}" << std::endl;
+                    out.print("{{\n");
+                    stream_out(cdb_.at(rcd_name), out.buffer(), indent+4);
+                    out.print("{:{}}}}\n", "", indent);
                 }
             }
             return interp::result_add_history;
         }
     };
 
+    // Completion of record names and tags, from tries kept by cdb_
+    using V = std::vector<std::string>;
+    auto name_then = [this](auto rest) {
+        return [this, rest](A &args, const std::string &word)->V {
+            return args.size() == 1 ? cdb_.complete_name(word) :
+                rest(args, word);
+        };
+    };
+    auto nothing = [](A &, const std::string &) { return V{}; };
+    for(auto cmd: {"remove", "open", "comment", "recipients"})
+        d[cmd].complete = name_then(nothing);
+    d["dump"].complete = [this](A &, const std::string &word) {
+        return cdb_.complete_name(word);
+    };
+    d["list"].complete = [this](A &args, const std::string &word) {
+        return args.size() == 1 ? cdb_.complete_tag(word) : V{};
+    };
+    d["tag"].complete = name_then([this](A &args, const std::string &word) {
+        return args.size() == 2 ? cdb_.complete_tag(word) : V{};
+    });
+    d["detag"].complete = name_then([this](A &args, const std::string &word) {
+        return args.size() == 2 ?
+            cmd_interp::complete_from(cdb_.tags(args[1]), word) : V{};
+    });
+
     return d;
 }
 
 pwdb_cmd_interp::
-pwdb_cmd_interp(pwdb::db &cdb, const cmd_interp::ops &ops) :
+pwdb_cmd_interp(pwdb::db &cdb, const cmd_interp::ops &ops, bool read_only) :
+    read_only_{read_only},
     cdb_{cdb},
     interp_{def_interp(ops)}
-{ ; }
+{
+    interp_.on_timed([](const std::string &cmd,
+                latency_histogram::duration took) {
+        command_latency().add(cmd, took);
+    });
+    // Any command but opening a prefetched record cancels the prefetch
+    interp_.on_command([this](const std::vector<std::string> &args) {
+        if(prefetch_) {
+            prefetch_->cancel(args.at(0) == "open" && args.size() > 1 ?
+                    args[1] : std::string{});
+        }
+    });
+}
+
+void pwdb_cmd_interp::
+prefetch(bool enable)
+{
+    if(!enable)
+        prefetch_.reset();
+    else if(!prefetch_)
+        prefetch_ = std::make_unique<pwdb::prefetcher>(cache_);
+}
+
+// Print names with their comments, sorted, and prefetch their stores
+void pwdb_cmd_interp::
+list_records(std::vector<std::string> names)
+{
+    std::sort(names.begin(), names.end());
+    if(format_ == output_format::text) {
+        std::deque<std::array<std::string, 2>> das{};
+        for(const auto &n: names)
+            das.push_back({n, cdb_.at(n).comment()});
+        cmd_interp::print_columns(std::cout, das.cbegin(), das.cend(), "  ",
+                "  ");
+    } else {
+        cmd_interp::output out;
+        row_writer rows{out.buffer(), format_, {"name", "comment"}};
+        for(const auto &n: names)
+            rows.row({n, cdb_.at(n).comment()});
+    }
+
+    if(!prefetch_ || names.size() > prefetch_max)
+        return;
+    std::vector<pwdb::prefetcher::job> jobs;
+    for(const auto &n: names) {
+        const auto &rcd = cdb_.at(n);
+        if(!rcd.has_store() && !rcd.data().empty() &&
+                !cache_.contains(n, rcd.data()))
+            jobs.push_back({n, rcd.data()});
+    }
+    if(!jobs.empty())
+        prefetch_->start(std::move(jobs));
+}
 
 //-----------------------------------------------------------------------------
 // rcd_cmd_interp
@@ -264,20 +514,24 @@ def_interp(const cmd_interp::ops &ops)
         }
     };
     d["set"] = { "(<KEY> [<VALUE>]) Set record key/value",
-        [this](A &args)->interp::result_t {
+        mutating(read_only_, [this](A &args)->interp::result_t {
             if(args.size() < 2) {
                 std::cerr << "Missing required argumant <KEY>" << std::endl;
                 interp_.help(std::cerr, args.at(0));
                 return interp::result_add_history;
             }
-            modified_ = true;
-            (*store_.mutable_values())[args[1]] =
-                cmd_interp::assemble(args.begin()+2, args.end());
+            auto value = cmd_interp::assemble(args.begin()+2, args.end());
+            auto &values = *store_.mutable_values();
+            auto i = values.find(args[1]);
+            if(i == values.end() || i->second != value) {
+                values[args[1]] = std::move(value);
+                modified_ = true;
+            }
             return interp::result_none;
-        }
+        })
     };
     d["unset"] = { "(<KEY>) Unset record key",
-        [this](A &args)->interp::result_t {
+        mutating(read_only_, [this](A &args)->interp::result_t {
             if(args.size() < 2) {
                 std::cerr << "Missing required argumant <KEY>" << std::endl;
                 interp_.help(std::cerr, args.at(0));
@@ -291,7 +545,7 @@ def_interp(const cmd_interp::ops &ops)
             modified_ = true;
             store_.mutable_values()->erase(i);
             return interp::result_add_history;
-        }
+        })
     };
     d["print"] = { "([<KEY>]...) Print key/values filtered by <KEY>s",
         [this](A &args)->interp::result_t {
@@ -307,19 +561,39 @@ def_interp(const cmd_interp::ops &ops)
                         das.push_back({*ki, i->second});
                     }
                 }
-                this->print_columns(das.cbegin(), das.cend());
+                this->print_rows(das.cbegin(), das.cend());
             }
             return interp::result_add_history;
         }
     };
 
+    // Completion of the keys set in the store
+    auto keys = [this](A &args, const std::string &word) {
+        std::vector<std::string> keys;
+        for(const auto &kv: store_.values())
+            keys.push_back(kv.first);
+        return cmd_interp::complete_from(keys, word);
+    };
+    auto first_key = [keys](A &args, const std::string &word) {
+        return args.size() == 1 ? keys(args, word) : std::vector<std::string>{};
+    };
+    d["set"].complete = first_key;
+    d["unset"].complete = first_key;
+    d["print"].complete = keys;
+
     return d;
 }
 
 rcd_cmd_interp::
-rcd_cmd_interp(const pwdb::pb::Store &store, const cmd_interp::ops &ops) :
-    store_{store}, interp_{def_interp(ops)}
-{ ; }
+rcd_cmd_interp(const pwdb::pb::Store &store, const cmd_interp::ops &ops,
+        bool read_only) :
+    read_only_{read_only}, store_{store}, interp_{def_interp(ops)}
+{
+    interp_.on_timed([](const std::string &cmd,
+                latency_histogram::duration took) {
+        command_latency().add("record " + cmd, took);
+    });
+}
 
 void rcd_cmd_interp::
 print(void) const
@@ -328,7 +602,7 @@ print(void) const
     for(const auto &entry: store_.values())
         das.push_back({entry.first, entry.second});
     std::sort(das.begin(), das.end());
-    this->print_columns(das.cbegin(), das.cend());
+    this->print_rows(das.cbegin(), das.cend());
 }
 
 } // namespace pwdb
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "pwdb/sha256.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace pwdb {
+
+static constexpr uint32_t round_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+void sha256::
+reset(void)
+{
+    state_ = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    buf_len_ = 0;
+    total_len_ = 0;
+}
+
+void sha256::
+compress(const uint8_t *block)
+{
+    using std::rotr;
+    uint32_t w[64];
+    for(int i = 0; i != 16; ++i) {
+        w[i] = uint32_t{block[4*i]} << 24 | uint32_t{block[4*i+1]} << 16 |
+            uint32_t{block[4*i+2]} << 8 | uint32_t{block[4*i+3]};
+    }
+    for(int i = 16; i != 64; ++i) {
+        auto s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+        auto s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    auto [a, b, c, d, e, f, g, h] = state_;
+    for(int i = 0; i != 64; ++i) {
+        auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) +
+            ((e & f) ^ (~e & g)) + round_k[i] + w[i];
+        auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) +
+            ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state_[0] += a; state_[1] += b; state_[2] += c; state_[3] += d;
+    state_[4] += e; state_[5] += f; state_[6] += g; state_[7] += h;
+}
+
+sha256 &sha256::
+update(const void *data, size_t len)
+{
+    auto p = static_cast<const uint8_t*>(data);
+    total_len_ += len;
+    if(buf_len_ != 0) {
+        auto n = std::min(len, buf_.size() - buf_len_);
+        std::memcpy(buf_.data() + buf_len_, p, n);
+        buf_len_ += n;
+        p += n;
+        len -= n;
+        if(buf_len_ != buf_.size())
+            return *this;
+        compress(buf_.data());
+        buf_len_ = 0;
+    }
+    for(; len >= buf_.size(); p += buf_.size(), len -= buf_.size())
+        compress(p);
+    std::memcpy(buf_.data(), p, len);
+    buf_len_ = len;
+    return *this;
+}
+
+sha256 &sha256::
+update_field(std::string_view s)
+{
+    uint8_t len[8];
+    for(int i = 0; i != 8; ++i)
+        len[i] = static_cast<uint8_t>(uint64_t{s.size()} >> (56 - 8*i));
+    return update(len, sizeof(len)).update(s);
+}
+
+sha256::digest sha256::
+finish(void)
+{
+    const uint64_t bits = total_len_ * 8;
+    static constexpr uint8_t pad[64] = {0x80};
+    update(pad, (buf_len_ < 56 ? 56 : 120) - buf_len_);
+    uint8_t len[8];
+    for(int i = 0; i != 8; ++i)
+        len[i] = static_cast<uint8_t>(bits >> (56 - 8*i));
+    update(len, sizeof(len));
+    digest d;
+    for(int i = 0; i != 8; ++i) {
+        d[4*i] = static_cast<uint8_t>(state_[i] >> 24);
+        d[4*i+1] = static_cast<uint8_t>(state_[i] >> 16);
+        d[4*i+2] = static_cast<uint8_t>(state_[i] >> 8);
+        d[4*i+3] = static_cast<uint8_t>(state_[i]);
+    }
+    reset();
+    return d;
+}
+
+hmac_sha256::
+hmac_sha256(std::string_view key)
+{
+    std::array<uint8_t, 64> inner_key{};
+    if(key.size() > inner_key.size()) {
+        const auto d = sha256::hash(key);
+        std::copy(d.begin(), d.end(), inner_key.begin());
+    } else {
+        std::memcpy(inner_key.data(), key.data(), key.size());
+    }
+    for(size_t i = 0; i != inner_key.size(); ++i) {
+        outer_key_[i] = inner_key[i] ^ 0x5c;
+        inner_key[i] ^= 0x36;
+    }
+    inner_.update(inner_key.data(), inner_key.size());
+}
+
+sha256::digest hmac_sha256::
+finish(void)
+{
+    const auto d = inner_.finish();
+    return sha256{}.update(outer_key_.data(), outer_key_.size())
+        .update(d.data(), d.size()).finish();
+}
+
+std::string
+to_hex(const sha256::digest &d)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string s;
+    s.reserve(d.size() * 2);
+    for(auto b: d) {
+        s += hex[b >> 4];
+        s += hex[b & 0xf];
+    }
+    return s;
+}
+
+} // namespace pwdb
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+#include "pwdb/store_cache.h"
+
+namespace pwdb {
+
+std::optional<pb::Store> store_cache::
+find(const std::string &name, const std::string &data,
+        std::vector<std::string> *keyids)
+{
+    const auto data_hash = sha256::hash(data);
+    std::lock_guard lock{mutex_};
+    expire_locked(clock::now());
+    auto i = index_.find(name);
+    if(i == index_.end() || i->second->data_hash != data_hash) {
+        ++stats_.misses;
+        return std::nullopt;
+    }
+    auto e = i->second;
+    pb::Store store;
+    const auto bytes = e->store.view();
+    if(!store.ParseFromArray(bytes.data(), static_cast<int>(bytes.size()))) {
+        drop(e);
+        ++stats_.misses;
+        return std::nullopt;
+    }
+    lru_.splice(lru_.begin(), lru_, e);
+    ++stats_.hits;
+    if(keyids != nullptr)
+        *keyids = e->keyids;
+    return store;
+}
+
+bool store_cache::
+contains(const std::string &name, const std::string &data) const
+{
+    const auto data_hash = sha256::hash(data);
+    std::lock_guard lock{mutex_};
+    auto i = index_.find(name);
+    return i != index_.end() && i->second->data_hash == data_hash &&
+        i->second->expires > clock::now();
+}
+
+void store_cache::
+insert(const std::string &name, const std::string &data,
+        const pb::Store &store, std::vector<std::string> keyids)
+{
+    std::string bytes;
+    store.SerializeToString(&bytes);
+    entry e{name, sha256::hash(data), locked_buffer{bytes}, std::move(keyids),
+        clock::now() + ttl_};
+    zeroize(bytes);
+
+    std::lock_guard lock{mutex_};
+    if(auto i = index_.find(name); i != index_.end())
+        drop(i->second);
+    if(e.store.size() > max_bytes_)
+        return;
+    expire_locked(clock::now());
+    while(stats_.bytes + e.store.size() > max_bytes_ && !lru_.empty()) {
+        drop(std::prev(lru_.end()));
+        ++stats_.evictions;
+    }
+    stats_.bytes += e.store.size();
+    ++stats_.entries;
+    if(!e.store.locked())
+        ++stats_.unlocked;
+    lru_.push_front(std::move(e));
+    index_[name] = lru_.begin();
+}
+
+void store_cache::
+erase(const std::string &name)
+{
+    std::lock_guard lock{mutex_};
+    if(auto i = index_.find(name); i != index_.end())
+        drop(i->second);
+}
+
+void store_cache::
+clear(void)
+{
+    std::lock_guard lock{mutex_};
+    while(!lru_.empty())
+        drop(lru_.begin());
+}
+
+void store_cache::
+expire(void)
+{
+    std::lock_guard lock{mutex_};
+    expire_locked(clock::now());
+}
+
+store_cache::stats_t store_cache::
+stats(void) const
+{
+    std::lock_guard lock{mutex_};
+    return stats_;
+}
+
+void store_cache::
+drop(lru_list::iterator i)
+{
+    stats_.bytes -= i->store.size();
+    --stats_.entries;
+    if(!i->store.locked())
+        --stats_.unlocked;
+    index_.erase(i->name);
+    lru_.erase(i);
+}
+
+void store_cache::
+expire_locked(clock::time_point now)
+{
+    // Entries are not reordered by age, so check them all; there are few
+    for(auto i = lru_.begin(); i != lru_.end();) {
+        auto next = std::next(i);
+        if(i->expires <= now) {
+            drop(i);
+            ++stats_.expirations;
+        }
+        i = next;
+    }
+}
+
+} // namespace pwdb
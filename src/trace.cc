@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "pwdb/trace.h"
+#include "pwdb/pb_json_codec.h"
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <unistd.h>
+}
+
+namespace pwdb {
+
+namespace {
+
+struct trace_event
+{
+    const char *name;
+    std::string detail;
+    pid_t tid;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+// Spans ended while the session is active, kept until it ends
+struct trace_log
+{
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point epoch;
+    std::vector<trace_event> events;
+};
+
+trace_log &
+the_log(void)
+{
+    static trace_log log;
+    return log;
+}
+
+// Microseconds since the epoch of the log, as trace events count time
+double
+trace_us(const trace_log &log, std::chrono::steady_clock::time_point t)
+{
+    using us = std::chrono::duration<double, std::micro>;
+    return std::chrono::duration_cast<us>(t - log.epoch).count();
+}
+
+} // namespace
+
+trace_session::
+trace_session(void) :
+    file_{[]() {
+        const char *file = getenv("PWDB_TRACE");
+        return file != nullptr ? std::string{file} : std::string{};
+    }()}
+{
+    if(file_.empty())
+        return;
+    auto &log = the_log();
+    {
+        std::lock_guard lock{log.mutex};
+        log.epoch = std::chrono::steady_clock::now();
+        log.events.clear();
+    }
+    active_.store(true, std::memory_order_relaxed);
+}
+
+trace_session::
+~trace_session()
+{
+    if(file_.empty())
+        return;
+    active_.store(false, std::memory_order_relaxed);
+    auto &log = the_log();
+    std::lock_guard lock{log.mutex};
+    try {
+        const auto pid = getpid();
+        std::string out{"{\"traceEvents\":["};
+        for(const auto &e: log.events) {
+            if(&e != &log.events.front())
+                out += ',';
+            out += "{\"name\":";
+            json_codec::write_string(out, e.name);
+            std::format_to(std::back_inserter(out), ",\"cat\":\"pwdb\","
+                    "\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},"
+                    "\"tid\":{}", trace_us(log, e.start),
+                    trace_us(log, e.end) - trace_us(log, e.start), pid, e.tid);
+            if(!e.detail.empty()) {
+                out += ",\"args\":{\"detail\":";
+                json_codec::write_string(out, e.detail);
+                out += '}';
+            }
+            out += '}';
+        }
+        out += "],\"displayTimeUnit\":\"ms\"}\n";
+        std::ofstream ofs(file_, std::ios::binary | std::ios::trunc);
+        ofs.exceptions(std::ios::badbit | std::ios::failbit);
+        // Spans reveal what a session did, so only the owner may read them
+        std::filesystem::permissions(file_, std::filesystem::perms::owner_read |
+                std::filesystem::perms::owner_write);
+        ofs << out;
+    } catch(const std::exception &e) {
+        std::cerr << "WARNING: Failed to write trace " << file_ << ": " <<
+            e.what() << std::endl;
+    }
+    log.events.clear();
+}
+
+void trace_span::
+end(void) noexcept
+{
+    const auto end = std::chrono::steady_clock::now();
+    if(!trace_session::active())
+        return;
+    auto &log = the_log();
+    try {
+        std::lock_guard lock{log.mutex};
+        log.events.push_back({name_, std::move(detail_), gettid(), start_,
+                end});
+    } catch(...) {
+        // A span missing from the trace is better than failing the work
+    }
+}
+
+} // namespace pwdb
@@ -20,15 +20,24 @@
 ***/
 
 #include "pwdb/util.h"
+#include "pwdb/trace.h"
 #include <filesystem>
 #include <fstream>
 #include <system_error>
 #include <cerrno>
+#include <csignal>
 #include <cstring>
+#include <new>
+#include <thread>
+#include <utility>
 
 extern "C" {
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
 #include <curses.h>
 #include <term.h>
 }
@@ -53,6 +62,25 @@ xdg_data_dir(void)
     return data_dir.string();
 }
 
+file_generation
+get_file_generation(const std::filesystem::path &file)
+{
+    struct stat st;
+    if(::stat(file.c_str(), &st) != 0) {
+        if(errno == ENOENT)
+            return file_generation{};
+        throw std::system_error(errno, std::generic_category(),
+                "Stat: "s + file.string());
+    }
+    return file_generation{
+        .exists = true,
+        .dev = static_cast<uint64_t>(st.st_dev),
+        .ino = static_cast<uint64_t>(st.st_ino),
+        .size = static_cast<uint64_t>(st.st_size),
+        .mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+            st.st_mtim.tv_nsec,
+    };
+}
 
 //----------------------------------------------------------------------------
 // lock_overwrite_file
@@ -78,6 +106,28 @@ lock_overwrite_file(const std::filesystem::path &file) :
     }
 }
 
+lock_overwrite_file::
+lock_overwrite_file(const std::filesystem::path &file,
+        std::chrono::milliseconds wait)
+{
+    using clock = std::chrono::steady_clock;
+    const auto deadline = clock::now() + wait;
+    while(true) {
+        try {
+            lock_overwrite_file lock{file};
+            swap(*this, lock);
+            return;
+        } catch(const std::system_error &) {
+            throw;
+        } catch(const std::runtime_error &) {
+            // File in use, other writers hold the lock only while saving
+            if(clock::now() >= deadline)
+                throw;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    }
+}
+
 lock_overwrite_file::
 lock_overwrite_file(lock_overwrite_file &&other) noexcept
 {
@@ -104,6 +154,7 @@ lock_overwrite_file::
 void lock_overwrite_file::
 overwrite(std::function<void(std::ostream&)> writer)
 {
+    trace_span span{"lock_overwrite_file::overwrite", file_.native()};
     std::ofstream out(tmp_file_,
             std::ios::binary | std::ios::trunc | std::ios::out);
     out.exceptions(std::ios::badbit | std::ios::failbit);
@@ -113,6 +164,27 @@ overwrite(std::function<void(std::ostream&)> writer)
     tmp_file_.clear();
 }
 
+void lock_overwrite_file::
+checkpoint(std::function<void(std::ostream&)> writer)
+{
+    trace_span span{"lock_overwrite_file::checkpoint", file_.native()};
+    // The temp file stays as the lock, so no other writer uses this one
+    const fs::path ckpt_file{file_.string() + ".ckpt"};
+    int fd = ::open(ckpt_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+            S_IRUSR | S_IWUSR);
+    if(fd < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                "Creating: "s + ckpt_file.string());
+    }
+    ::close(fd);
+    std::ofstream out(ckpt_file,
+            std::ios::binary | std::ios::trunc | std::ios::out);
+    out.exceptions(std::ios::badbit | std::ios::failbit);
+    writer(out);
+    out.close();
+    fs::rename(ckpt_file, file_);
+}
+
 void swap(lock_overwrite_file &lhs, lock_overwrite_file &rhs) noexcept
 {
     using std::swap;
@@ -120,6 +192,189 @@ void swap(lock_overwrite_file &lhs, lock_overwrite_file &rhs) noexcept
     swap(lhs.tmp_file_, rhs.tmp_file_);
 }
 
+//----------------------------------------------------------------------------
+// interrupt_guard
+//----------------------------------------------------------------------------
+
+static volatile std::sig_atomic_t sigint_caught = 0;
+
+extern "C" void
+sigint_handler(int)
+{
+    sigint_caught = 1;
+}
+
+interrupt_guard::
+interrupt_guard(void)
+{
+    sigint_caught = 0;
+    struct sigaction action{};
+    action.sa_handler = sigint_handler;
+    sigemptyset(&action.sa_mask);
+    if(::sigaction(SIGINT, &action, &old_action_) != 0) {
+        throw std::system_error(errno, std::generic_category(),
+                "sigaction");
+    }
+}
+
+interrupt_guard::
+~interrupt_guard()
+{
+    ::sigaction(SIGINT, &old_action_, nullptr);
+}
+
+bool interrupt_guard::
+interrupted(void) const
+{
+    return sigint_caught != 0;
+}
+
+//----------------------------------------------------------------------------
+// locked_buffer
+//----------------------------------------------------------------------------
+
+void
+zeroize(std::string &s) noexcept
+{
+    if(!s.empty())
+        ::explicit_bzero(s.data(), s.size());
+}
+
+// Bytes of whole pages holding size bytes, at least one page
+static size_t
+page_rounded(size_t size)
+{
+    static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return size == 0 ? page : (size + page - 1) / page * page;
+}
+
+// Each buffer has pages of its own, as page locks are not counted: unlocking
+// a buffer sharing a page would unlock the others on it too
+locked_buffer::
+locked_buffer(std::string_view bytes) :
+    size_{bytes.size()},
+    mapped_{page_rounded(size_)}
+{
+    void *p = ::mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+        throw std::bad_alloc{};
+    data_ = static_cast<char *>(p);
+    ::madvise(data_, mapped_, MADV_DONTDUMP);
+    locked_ = ::mlock(data_, mapped_) == 0;
+    std::memcpy(data_, bytes.data(), size_);
+}
+
+locked_buffer::
+locked_buffer(locked_buffer &&other) noexcept :
+    data_{std::exchange(other.data_, nullptr)},
+    size_{std::exchange(other.size_, 0)},
+    mapped_{std::exchange(other.mapped_, 0)},
+    locked_{std::exchange(other.locked_, false)}
+{ ; }
+
+locked_buffer &locked_buffer::
+operator=(locked_buffer &&other) noexcept
+{
+    if(this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        mapped_ = std::exchange(other.mapped_, 0);
+        locked_ = std::exchange(other.locked_, false);
+    }
+    return *this;
+}
+
+locked_buffer::
+~locked_buffer()
+{
+    release();
+}
+
+void locked_buffer::
+release(void) noexcept
+{
+    if(data_ == nullptr)
+        return;
+    ::explicit_bzero(data_, size_);
+    if(locked_)
+        ::munlock(data_, mapped_);
+    ::munmap(data_, mapped_);
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = 0;
+    locked_ = false;
+}
+
+//----------------------------------------------------------------------------
+// file_watch
+//----------------------------------------------------------------------------
+
+file_watch::
+file_watch(const std::filesystem::path &file) :
+    fd_{::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)}
+{
+    if(fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                "inotify_init1");
+    }
+    auto abs_file = fs::weakly_canonical(file);
+    name_ = abs_file.filename().string();
+    if(::inotify_add_watch(fd_, abs_file.parent_path().c_str(),
+                IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        auto err = errno;
+        ::close(fd_);
+        throw std::system_error(err, std::generic_category(),
+                "Watching: "s + abs_file.parent_path().string());
+    }
+}
+
+file_watch::
+~file_watch()
+{
+    ::close(fd_);
+}
+
+bool file_watch::
+wait(std::chrono::milliseconds timeout)
+{
+    struct pollfd pfd{.fd = fd_, .events = POLLIN, .revents = 0};
+    if(::poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0)
+        return false;
+    // Drain all pending events, other files in the directory are ignored
+    bool changed = false;
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while((len = ::read(fd_, buf, sizeof(buf))) > 0) {
+        for(char *p = buf; p < buf + len; ) {
+            auto *ev = reinterpret_cast<struct inotify_event*>(p);
+            if(ev->len != 0 && name_ == ev->name)
+                changed = true;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return changed;
+}
+
+//----------------------------------------------------------------------------
+// generator_streambuf
+//----------------------------------------------------------------------------
+
+generator_streambuf::int_type generator_streambuf::
+underflow(void)
+{
+    // Loop since the generator may legitimately produce empty chunks
+    while(gptr() == egptr()) {
+        auto chunk = gen_();
+        if(!chunk)
+            return traits_type::eof();
+        buf_ = std::move(*chunk);
+        setg(buf_.data(), buf_.data(), buf_.data() + buf_.size());
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
 //----------------------------------------------------------------------------
 // term_mode
 //----------------------------------------------------------------------------
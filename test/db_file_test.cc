@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+
+#include "pwdb/db_file.h"
+#include "pwdb/pb_gpg.h"
+#include "pwdb/db_utils.h"
+#include <google/protobuf/util/message_differencer.h>
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <functional>
+#include <random>
+
+namespace fs = std::filesystem;
+using google::protobuf::util::MessageDifferencer;
+
+static constexpr char progname[] = "db_file_test";
+static const std::string uid{"ctest@testson.name"};
+
+bool tassert(bool pass, std::string desc)
+{
+    if(!pass) {
+        std::cerr << "FAILED: " << desc << std::endl;
+    }
+    return !pass;
+}
+
+// Enough records of stand in ciphertext to need several chunks
+static pwdb::pb::DB
+gen_db(size_t nrecords)
+{
+    std::mt19937 rng{42};
+    pwdb::pb::DB pb_db;
+    pb_db.set_uid(uid);
+    for(size_t i = 0; i != nrecords; ++i) {
+        auto name = "record " + std::to_string(i);
+        auto &rcd = (*pb_db.mutable_records())[name];
+        std::string data(200, '\0');
+        for(auto &c: data)
+            c = char(rng());
+        rcd.set_data(data);
+        rcd.set_comment("Comment " + std::to_string(i));
+        (*pb_db.mutable_tags())["tag " + std::to_string(i % 7)].add_str(name);
+    }
+    return pb_db;
+}
+
+static std::string
+write(gpgh::context &ctx, const pwdb::pb::DB &pb_db,
+        pwdb::chunk_cache *cache = nullptr)
+{
+    std::stringstream out;
+    pwdb::write_db(ctx, {uid}, pb_db, out, cache);
+    return out.str();
+}
+
+static pwdb::verified_db
+read(gpgh::context &ctx, const std::string &file,
+        pwdb::chunk_cache *cache = nullptr)
+{
+    std::stringstream in{file};
+    return pwdb::read_db(ctx, in, cache);
+}
+
+int
+roundtrip_test(gpgh::context &ctx)
+{
+    bool ret = 0;
+    auto pb_db = gen_db(2000);
+    (*pb_db.mutable_key_pin())[uid].add_str("0123456789ABCDEF");
+    const auto file = write(ctx, pb_db);
+    std::stringstream in{file};
+    ret |= tassert(pwdb::is_chunked(in), "Chunked format");
+    auto vdb = read(ctx, file);
+    ret |= tassert(MessageDifferencer::Equals(pb_db, vdb.pb), "Round trip");
+    ret |= tassert(vdb.pb.key_pin().count(uid) == 1 &&
+            vdb.pb.key_pin().at(uid).str(0) == "0123456789ABCDEF",
+            "Key pin kept");
+    ret |= tassert(!vdb.sigs.empty(), "Index signed");
+
+    // Whole file format is still read
+    const auto legacy = pwdb::encode_data(ctx, uid, pb_db, true);
+    std::stringstream legacy_in{legacy};
+    ret |= tassert(!pwdb::is_chunked(legacy_in), "Whole file format");
+    ret |= tassert(MessageDifferencer::Equals(pb_db, read(ctx, legacy).pb),
+            "Read whole file format");
+
+    // A damaged chunk is detected
+    auto damaged = file;
+    damaged[damaged.size() - 10] ^= 0x55;
+    try {
+        read(ctx, damaged);
+        ret |= tassert(false, "Damaged chunk rejected");
+    } catch(const std::exception &) {
+    }
+
+    // A huge chunk count is rejected before reading any chunk sizes
+    auto huge = file;
+    const auto magic_size = huge.find('\n') + 1;
+    huge.replace(magic_size, 4, "\xff\xff\xff\xff");
+    try {
+        read(ctx, huge);
+        ret |= tassert(false, "Chunk count rejected");
+    } catch(const std::exception &e) {
+        ret |= tassert(std::string(e.what()).find("chunk count") !=
+                std::string::npos, "Chunk count rejected");
+    }
+
+    // A chunk size past the end of the file is rejected before allocating
+    auto past_end = file;
+    past_end.replace(magic_size + 4 + 8, 8, "\0\0\0\0\xff\xff\xff\xff", 8);
+    try {
+        read(ctx, past_end);
+        ret |= tassert(false, "Chunk size past end rejected");
+    } catch(const std::exception &e) {
+        ret |= tassert(std::string(e.what()) == "Truncated pwdb file",
+                "Chunk size past end rejected");
+    }
+    return ret;
+}
+
+int
+reuse_test(gpgh::context &ctx)
+{
+    bool ret = 0;
+    auto pb_db = gen_db(2000);
+    pwdb::chunk_cache cache;
+    read(ctx, write(ctx, pb_db), &cache);
+    const auto nchunks = cache.ciphertext.size();
+    ret |= tassert(nchunks > 4, "Several chunks");
+
+    // Unchanged DB writes the same chunk ciphertexts, in the same file bytes
+    // but for the index
+    auto first = write(ctx, pb_db, &cache);
+    auto second = write(ctx, pb_db, &cache);
+    ret |= tassert(cache.ciphertext.size() == nchunks, "All chunks reused");
+    ret |= tassert(first.size() == second.size() && first.substr(
+                first.size() - first.size() / 2) == second.substr(
+                second.size() - second.size() / 2), "Same chunk bytes");
+
+    // An edit changes one chunk
+    (*pb_db.mutable_records())["record 1234"].set_comment("Edited");
+    auto edited = write(ctx, pb_db, &cache);
+    ret |= tassert(cache.ciphertext.size() == nchunks + 1, "One new chunk");
+    ret |= tassert(MessageDifferencer::Equals(pb_db, read(ctx, edited).pb),
+            "Read edited");
+
+    // Other recipients invalidate the cache
+    cache.recipients = {"other@testson.name"};
+    write(ctx, pb_db, &cache);
+    ret |= tassert(cache.recipients == std::vector<std::string>{uid} &&
+            cache.ciphertext.size() == nchunks, "Cache per recipients");
+    return ret;
+}
+
+int
+backup_test(gpgh::context &ctx)
+{
+    bool ret = 0;
+    pwdb::db cdb{};
+    cdb.uid(uid);
+    for(size_t i = 0; i != 20; ++i) {
+        auto name = "record " + std::to_string(i);
+        pwdb::pb::Store store;
+        (*store.mutable_values())["password"] = "pw " + std::to_string(i);
+        cdb.add(name);
+        pwdb::db_save_rcd_store(ctx, cdb, name, store);
+        cdb.entag(name, "tag " + std::to_string(i % 3));
+    }
+
+    // Backup as subcmd_backup writes it
+    std::string backup;
+    {
+        gpgh::context bak_ctx{ctx.home_dir()};
+        gpgh::context dec_ctx{ctx.home_dir()};
+        auto keys = pwdb::db_add_signer(bak_ctx, cdb);
+        std::stringstream out;
+        pwdb::encode_delimited<pwdb::pb::DB>(bak_ctx, keys,
+                pwdb::db_decrypted_fragments(dec_ctx, cdb), out, true);
+        backup = out.str();
+    }
+
+    // Restore as subcmd_restore reads it
+    pwdb::pb::DB restored;
+    size_t nfrags = 0;
+    std::stringstream in{backup};
+    pwdb::decode_delimited<pwdb::pb::DB>(ctx, in,
+            [&](pwdb::pb::DB &&frag) {
+                ++nfrags;
+                restored.MergeFrom(frag);
+            });
+    ret |= tassert(nfrags == 1 + 20 + 3, "Fragments");
+
+    // Same uid, tags and records, with the stores decrypted
+    pwdb::pb::DB expect;
+    expect.set_uid(uid);
+    *expect.mutable_tags() = cdb.pb().tags();
+    for(const auto &[name, rcd]: cdb) {
+        auto &exp_rcd = (*expect.mutable_records())[name];
+        exp_rcd = rcd;
+        *exp_rcd.mutable_store() = pwdb::db_open_rcd_store(ctx, rcd);
+        exp_rcd.clear_key_fpr();
+    }
+    ret |= tassert(restored.records().at("record 7").store().values().at(
+                "password") == "pw 7", "Store restored");
+    ret |= tassert(MessageDifferencer::Equals(expect, restored),
+            "Backup round trip");
+
+    // Messages straddling slices parse the same
+    std::stringstream enc{backup};
+    const auto plain = ctx.decrypt(enc);
+    pwdb::pb::DB sliced;
+    pwdb::parse_delimited<pwdb::pb::DB>(plain,
+            [&](pwdb::pb::DB &&frag) { sliced.MergeFrom(frag); }, 7);
+    ret |= tassert(MessageDifferencer::Equals(expect, sliced),
+            "Parse across slices");
+
+    // A message cut short is an error, not a clean end
+    try {
+        pwdb::parse_delimited<pwdb::pb::DB>(
+                std::string_view{plain}.substr(0, plain.size() - 1),
+                [](pwdb::pb::DB &&) {}, 7);
+        ret |= tassert(false, "Truncated backup rejected");
+    } catch(const std::runtime_error &) {
+    }
+    return ret;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    if(argc < 2) {
+        std::cerr << progname << ": No test to run" << std::endl;
+        return 1;
+    }
+    std::string test_name(argv[1]);
+
+    // testing home directory and uid
+    auto gpg_home = fs::current_path().append("gnupg");
+    fs::create_directory(gpg_home);
+    fs::permissions(gpg_home, fs::perms::owner_all);
+    try {
+        gpgh::context ctx{gpg_home};
+        gpgh::gen_test_key(ctx, uid);
+        ctx.add_signer(uid);
+
+        if(test_name == "roundtrip")
+            return roundtrip_test(ctx);
+        if(test_name == "reuse")
+            return reuse_test(ctx);
+        if(test_name == "backup")
+            return backup_test(ctx);
+    } catch(const std::exception &e) {
+        std::cerr << progname << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/***
+    This file is part of pwdb.
+
+    Copyright (C) 2026 Edward Branch
+
+    This program is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program. If not, see <https://www.gnu.org/licenses/>.
+
+***/
+
+// Compare the specialized JSON codec against protobuf reflection JSON
+
+#include "pwdb/pb_json_codec.h"
+#include <google/protobuf/util/json_util.h>
+#include <iostream>
+#include <format>
+#include <chrono>
+#include <functional>
+#include <string>
+
+static constexpr char progname[] = "db_json_bench";
+
+static pwdb::pb::DB
+gen_db(size_t nrecords)
+{
+    pwdb::pb::DB pb_db;
+    pb_db.set_uid("bench@pwdb.test");
+    for(size_t i = 0; i != nrecords; ++i) {
+        auto name = std::format("record_{:08}", i);
+        auto &rcd = (*pb_db.mutable_records())[name];
+        auto &values = *rcd.mutable_store()->mutable_values();
+        values["login"] = std::format("user{}@example.com", i);
+        values["password"] = std::format("p\"w\\{}\t{:x}", i, i * 2654435761u);
+        values["url"] = std::format("https://www.site{}.example.com/login", i);
+        rcd.set_comment(std::format("Comment for record {}", i));
+        rcd.add_recipient("bench@pwdb.test");
+        (*pb_db.mutable_tags())[std::format("tag{}", i % 50)].add_str(name);
+    }
+    return pb_db;
+}
+
+// Best of several runs, in MB/s of JSON
+static double
+bench(size_t bytes, const std::function<void(void)> &fn)
+{
+    using clock = std::chrono::steady_clock;
+    std::chrono::duration<double> best{1e9};
+    for(int run = 0; run != 5; ++run) {
+        auto start = clock::now();
+        fn();
+        best = std::min<std::chrono::duration<double>>(best,
+                clock::now() - start);
+    }
+    return bytes / best.count() / 1e6;
+}
+
+int main(int argc, const char *argv[])
+{
+    namespace gpu = google::protobuf::util;
+    const size_t nrecords = argc > 1 ? std::stoul(argv[1]) : 20000;
+    const auto pb_db = gen_db(nrecords);
+
+    gpu::JsonPrintOptions popts;
+    popts.preserve_proto_field_names = true;
+    std::string json;
+    if(!gpu::MessageToJsonString(pb_db, &json, popts).ok()) {
+        std::cerr << progname << ": reflection print failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::format("{}: {} records, {} bytes of JSON\n", progname,
+            nrecords, json.size());
+    auto report = [](const char *what, double reflect, double codec) {
+        std::cout << std::format("  {:<6} reflection {:8.1f} MB/s  "
+                "codec {:8.1f} MB/s  ({:.1f}x)\n", what, reflect, codec,
+                codec / reflect);
+    };
+
+    auto write_reflect = bench(json.size(), [&pb_db, &popts]() {
+        std::string out;
+        (void)gpu::MessageToJsonString(pb_db, &out, popts);
+    });
+    auto write_codec = bench(json.size(), [&pb_db]() {
+        std::string out;
+        pwdb::json_codec::write(out, pb_db);
+    });
+    report("write", write_reflect, write_codec);
+
+    auto parse_reflect = bench(json.size(), [&json]() {
+        pwdb::pb::DB msg;
+        (void)gpu::JsonStringToMessage(json, &msg);
+    });
+    auto parse_codec = bench(json.size(), [&json]() {
+        pwdb::pb::DB msg;
+        pwdb::json_codec::parse(json, msg);
+    });
+    report("parse", parse_reflect, parse_codec);
+    std::cout << std::flush;
+
+    return 0;
+}
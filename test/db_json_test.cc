@@ -20,11 +20,15 @@
 ***/
 
 #include "pwdb/pb_json.h"
+#include "pwdb/pb_json_codec.h"
 #include "pwdb/db.h"
+#include "pwdb/output_format.h"
+#include <google/protobuf/util/message_differencer.h>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <functional>
+#include <random>
 
 static constexpr char progname[] = "db_json_test";
 
@@ -99,6 +103,290 @@ bool basic_test(void)
     return ret;
 }
 
+bool ndjson_test(void)
+{
+    bool ret = 0;
+
+    // Write proto_db1 one record or tag per line, as export does
+    auto pb_db = pwdb::json2pb<pwdb::pb::DB>(proto_db1_json);
+    std::string ndjson;
+    {
+        pwdb::pb::DB line;
+        line.set_uid(pb_db.uid());
+        ndjson += pwdb::pb2json_line(line);
+    }
+    for(const auto &rcd: pb_db.records()) {
+        pwdb::pb::DB line;
+        (*line.mutable_records())[rcd.first] = rcd.second;
+        ndjson += pwdb::pb2json_line(line);
+    }
+    for(const auto &tag: pb_db.tags()) {
+        pwdb::pb::DB line;
+        (*line.mutable_tags())[tag.first] = tag.second;
+        ndjson += pwdb::pb2json_line(line);
+    }
+
+    ret |= tassert([&ndjson]()->bool {
+            return pwdb::is_ndjson(ndjson);
+        }, "Detect NDJSON");
+    ret |= tassert([&pb_db]()->bool {
+            return !pwdb::is_ndjson(pwdb::pb2json(pb_db));
+        }, "Detect multi-line JSON");
+    pwdb::db cdb;
+    ret |= tassert([&cdb, &ndjson]()->bool {
+            cdb = pwdb::ndjson2pb<pwdb::pb::DB>(ndjson);
+            return true;
+        }, "Import db from NDJSON");
+    ret |= tassert([&cdb, &pb_db]()->bool {
+            return cdb.uid() == pb_db.uid() && cdb.size() == 4;
+        }, "NDJSON uid and number of records");
+    ret |= tassert([&cdb]()->bool {
+            return cdb.at("complete_a_b").recipient_size() == 2 &&
+                cdb.tags("complete_a_b").size() == 2 &&
+                cdb.at_tag("b").size() == 2;
+        }, "NDJSON record and tags");
+
+    return ret;
+}
+
+// Random strings biased towards characters that stress JSON escaping and
+// the block boundaries of the structural scanner
+static std::string
+random_string(std::mt19937 &rng, size_t max_len)
+{
+    static const std::string pieces[] = {"a", "Z", "0", " ", "\"", "\\",
+        "\\\\", "\\\"", "{", "}", "[", "]", ":", ",", "\n", "\t",
+        std::string(1, '\x01'), "\xc3\xa9", "\xe2\x82\xac",
+        "\xf0\x9f\x94\x91", "null", "/"};
+    std::uniform_int_distribution<size_t> len_dist(0, max_len);
+    std::uniform_int_distribution<size_t> piece_dist(0, std::size(pieces) - 1);
+    std::string s;
+    for(auto len = len_dist(rng); s.size() < len; )
+        s += pieces[piece_dist(rng)];
+    return s;
+}
+
+static pwdb::pb::DB
+random_db(std::mt19937 &rng, size_t nrecords)
+{
+    pwdb::pb::DB pb_db;
+    pb_db.set_uid(random_string(rng, 20));
+    for(size_t i = 0; i != nrecords; ++i) {
+        auto name = random_string(rng, 80) + std::to_string(i);
+        auto &rcd = (*pb_db.mutable_records())[name];
+        if(rng() % 3 == 0) {
+            auto &values = *rcd.mutable_store()->mutable_values();
+            for(auto n = rng() % 4; n != 0; --n)
+                values[random_string(rng, 10)] = random_string(rng, 100);
+        } else if(rng() % 2) {
+            std::string data;
+            for(auto n = rng() % 70; n != 0; --n)
+                data.push_back(char(rng()));
+            rcd.set_data(data);
+            for(auto n = rng() % 2; n != 0; --n)
+                rcd.add_key_fpr(random_string(rng, 40));
+        }
+        rcd.set_comment(random_string(rng, 40));
+        for(auto n = rng() % 3; n != 0; --n)
+            rcd.add_recipient(random_string(rng, 20));
+        if(rng() % 2)
+            (*pb_db.mutable_tags())[random_string(rng, 8)].add_str(name);
+    }
+    if(rng() % 2) {
+        auto &merkle = *pb_db.mutable_merkle();
+        merkle.set_depth(rng() % 3);
+        for(auto n = rng() % 8; n != 0; --n) {
+            std::string node(32, '\0');
+            for(auto &c: node)
+                c = char(rng());
+            merkle.add_node(node);
+        }
+        for(auto n = rng() % 3; n != 0; --n) {
+            auto &leaf = *merkle.add_leaf();
+            for(auto k = rng() % 3; k != 0; --k) {
+                leaf.add_name(random_string(rng, 12));
+                leaf.add_digest(random_string(rng, 32));
+            }
+        }
+    }
+    for(auto n = rng() % 3; n != 0; --n) {
+        auto &pin = (*pb_db.mutable_key_pin())[random_string(rng, 20)];
+        for(auto k = rng() % 3; k != 0; --k)
+            pin.add_str(random_string(rng, 40));
+    }
+    return pb_db;
+}
+
+bool codec_test(void)
+{
+    using google::protobuf::util::MessageDifferencer;
+    namespace gpu = google::protobuf::util;
+    bool ret = 0;
+
+    auto reflect_parse = [](const std::string &json)->pwdb::pb::DB {
+        pwdb::pb::DB msg;
+        if(!gpu::JsonStringToMessage(json, &msg).ok())
+            throw std::runtime_error("reflection parse failed");
+        return msg;
+    };
+    auto reflect_print = [](const pwdb::pb::DB &msg, bool ws)->std::string {
+        gpu::JsonPrintOptions jopts;
+        jopts.preserve_proto_field_names = true;
+        jopts.add_whitespace = ws;
+        std::string json;
+        gpu::MessageToJsonString(msg, &json, jopts);
+        return json;
+    };
+
+    ret |= tassert([&reflect_parse]()->bool {
+            pwdb::pb::DB msg;
+            pwdb::json_codec::parse(proto_db1_json, msg);
+            return MessageDifferencer::Equals(msg,
+                    reflect_parse(proto_db1_json));
+        }, "Codec parse matches reflection");
+
+    // Structural index against a byte at a time reference
+    std::mt19937 rng{1234};
+    ret |= tassert([&rng]()->bool {
+        for(int n = 0; n != 200; ++n) {
+            std::string json;
+            for(int k = 0; k != 20; ++k) {
+                auto s = random_string(rng, 90);
+                pwdb::json_codec::write_string(json, s);
+                json += ",:{}"[rng() % 4];
+            }
+            std::vector<uint32_t> ref;
+            bool in_str = false;
+            for(size_t i = 0; i != json.size(); ++i) {
+                const char c = json[i];
+                if(in_str && c == '\\') {
+                    ++i;
+                } else if(c == '"') {
+                    in_str = !in_str;
+                    ref.push_back(i);
+                } else if(!in_str && std::string_view{"{}[]:,"}.find(c) !=
+                        std::string_view::npos) {
+                    ref.push_back(i);
+                }
+            }
+            if(ref != pwdb::json_codec::structural_index(json))
+                return false;
+        }
+        return true;
+    }, "Structural index");
+
+    // Round trips in both directions against the reflection codec
+    for(int n = 0; n != 20; ++n) {
+        auto pb_db = random_db(rng, 50);
+        ret |= tassert([&]()->bool {
+            std::string json;
+            pwdb::json_codec::write(json, pb_db);
+            return MessageDifferencer::Equals(pb_db, reflect_parse(json));
+        }, "Codec write, reflection parse");
+        ret |= tassert([&]()->bool {
+            pwdb::pb::DB compact, pretty;
+            pwdb::json_codec::parse(reflect_print(pb_db, false), compact);
+            pwdb::json_codec::parse(reflect_print(pb_db, true), pretty);
+            return MessageDifferencer::Equals(pb_db, compact) &&
+                MessageDifferencer::Equals(pb_db, pretty);
+        }, "Reflection write, codec parse");
+    }
+
+    // Malformed input
+    for(auto bad: {R"({"uid": "a", "bogus": 1})", R"({"uid": "a"} x)",
+            R"({"uid": "a)", R"({"uid" "a"})", R"({"uid": nul})",
+            R"({"records": {"r": {"data": "QQ", "store": {}}}})",
+            R"({"merkle": {"depth": -1}})", R"({"merkle": {"depth": 1x}})"}) {
+        ret |= tassert([bad]()->bool {
+            try {
+                pwdb::pb::DB msg;
+                pwdb::json_codec::parse(bad, msg);
+            } catch(const std::runtime_error &) {
+                return true;
+            }
+            return false;
+        }, std::string("Reject ") + bad);
+    }
+
+    return ret;
+}
+
+int
+output_test(void)
+{
+    using pwdb::output_format;
+    bool ret = 0;
+
+    ret |= tassert([]()->bool {
+        std::string out;
+        {
+            pwdb::row_writer rows{out, output_format::json, {"name", "c"}};
+            rows.row({"a", "x\"y"});
+            rows.row({"b\tc", ""});
+        }
+        return out == "[{\"name\":\"a\",\"c\":\"x\\\"y\"},"
+            "{\"name\":\"b\\tc\",\"c\":\"\"}]\n";
+    }, "JSON rows");
+    ret |= tassert([]()->bool {
+        std::string out;
+        {
+            pwdb::row_writer rows{out, output_format::json, {"tag"}};
+        }
+        return out == "[]\n";
+    }, "JSON no rows");
+    ret |= tassert([]()->bool {
+        std::string out;
+        {
+            pwdb::row_writer rows{out, output_format::tsv, {"name", "c"}};
+            rows.row({"a", "x\ty\\z\n"});
+            rows.row({"b", ""});
+        }
+        return out == "a\tx\\ty\\\\z\\n\nb\t\n";
+    }, "TSV rows");
+
+    pwdb::db cdb{};
+    cdb.uid("me");
+    pwdb::pb::Record rcd;
+    rcd.set_comment("one");
+    rcd.add_recipient("r1");
+    rcd.add_recipient("r2");
+    cdb.add("b", rcd);
+    cdb.add("a");
+    cdb.entag("a", "t");
+    cdb.entag("b", "t");
+    ret |= tassert([&cdb]()->bool {
+        std::string out;
+        pwdb::write_dump(out, output_format::json, cdb, {});
+        return out == R"({"uid":"me","records":{"a":{"comment":"",)"
+            R"("recipient":[]},"b":{"comment":"one","recipient":["r1","r2"]}},)"
+            R"("tags":{"t":["a","b"]}})" "\n";
+    }, "JSON dump");
+    ret |= tassert([&cdb]()->bool {
+        std::string out;
+        pwdb::write_dump(out, output_format::json, cdb, {"b", "c"});
+        return out == R"({"records":{"b":{"comment":"one",)"
+            R"("recipient":["r1","r2"]},"c":null}})" "\n";
+    }, "JSON dump named");
+    ret |= tassert([&cdb]()->bool {
+        std::string out;
+        pwdb::write_dump(out, output_format::tsv, cdb, {});
+        std::string named;
+        pwdb::write_dump(named, output_format::tsv, cdb, {"c"});
+        return out == "uid\tme\nrecord\ta\t\t\nrecord\tb\tone\tr1,r2\n"
+            "tag\tt\ta,b\n" && named == "missing\tc\n";
+    }, "TSV dump");
+    ret |= tassert([]()->bool {
+        try {
+            pwdb::parse_output_format("xml");
+        } catch(const std::runtime_error &) {
+            return pwdb::parse_output_format("tsv") == output_format::tsv;
+        }
+        return false;
+    }, "Output format names");
+
+    return ret;
+}
+
 int main(int argc, const char *argv[])
 {
     if(argc < 2) {
@@ -109,6 +397,12 @@ int main(int argc, const char *argv[])
 
     if(test_name == "basic")
         return basic_test();
+    if(test_name == "ndjson")
+        return ndjson_test();
+    if(test_name == "codec")
+        return codec_test();
+    if(test_name == "output")
+        return output_test();
 
     return 0;
 }
@@ -20,10 +20,27 @@
 ***/
 
 #include "pwdb/db.h"
+#include "pwdb/db_merge.h"
+#include "pwdb/db_merkle.h"
+#include "pwdb/db_utils.h"
+#include "pwdb/latency.h"
+#include "pwdb/store_cache.h"
+#include "pwdb/trace.h"
+#include "pwdb/util.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <iostream>
 #include <vector>
 #include <functional>
 #include <algorithm>
+#include <thread>
+extern "C" {
+#include <unistd.h>
+} // extern "C"
 
 constexpr const char progname[] = "db_test";
 
@@ -76,6 +93,29 @@ add_remove_test(void)
     ret |= tassert(cdb.size() == 4, "Record add");
     ret |= tassert(cdb.at("one").comment() == "www.record_one.com", "at()");
 
+    // Key fingerprints follow the payload they describe
+    cdb.set_data("two", "Encrypted", {"FPR1", "FPR2"});
+    ret |= tassert(cdb.at("two").key_fpr_size() == 2, "Set key fingerprints");
+    cdb.set_data("two", "Encrypted again");
+    ret |= tassert(cdb.at("two").key_fpr_size() == 0,
+            "Data clears key fingerprints");
+    cdb.key_fprs("two", {"FPR3"});
+    cdb.set_store("two", pwdb::pb::Store{});
+    ret |= tassert(cdb.at("two").key_fpr_size() == 0,
+            "Store clears key fingerprints");
+
+    // Stores are encrypted to the uid and the record's own recipients
+    cdb.uid("owner@pwdb.test");
+    ret |= tassert(cdb.recipients("two", {"a@pwdb.test", "owner@pwdb.test"}) &&
+            !cdb.recipients("nonexist", {}), "Set recipients");
+    ret |= tassert(pwdb::rcd_recipients(cdb, cdb.at("two")) ==
+            std::vector<std::string>{"owner@pwdb.test", "a@pwdb.test"},
+            "Record recipients");
+    cdb.key_pin("a@pwdb.test", {"FPR1"});
+    ret |= tassert(cdb.key_pin("a@pwdb.test") ==
+            std::vector<std::string>{"FPR1"} &&
+            cdb.key_pin("b@pwdb.test").empty(), "Key pins");
+
     // Remove
     ret |= tassert(cdb.remove("three") == 1, "Call remove");
     ret |= tassert(cdb.size() == 3, "Size on remove");
@@ -127,6 +167,493 @@ tags_test(void)
     return ret;
 }
 
+int
+merge3_test(void)
+{
+    bool ret = 0;
+    const pwdb::db base{gen_test_recordv()};
+
+    // theirs: modify one, add five, remove four, retag
+    pwdb::db theirs{base.copy()};
+    theirs.comment("one", "theirs one");
+    theirs.add("five");
+    theirs.entag("five", "one two");
+    theirs.remove("four");
+    theirs.detag("three", "two three");
+
+    // ours: modify two, add six, and conflicting changes to three
+    pwdb::db ours{base.copy()};
+    ours.comment("two", "ours two");
+    ours.add("six");
+    ours.comment("three", "ours three");
+    theirs.comment("three", "theirs three");
+
+    auto res = pwdb::db_merge3(ours, base.pb(), theirs.pb());
+    ret |= tassert(ours.at("one").comment() == "theirs one", "Take theirs");
+    ret |= tassert(ours.at("two").comment() == "ours two", "Keep ours");
+    ret |= tassert(ours.count("five") == 1 && ours.count("six") == 1,
+            "Both adds");
+    ret |= tassert(ours.count("four") == 0, "Their remove");
+    ret |= tassert(ours.tags("five").count("one two") == 1 &&
+            ours.tags("three").count("two three") == 0, "Their tags");
+    ret |= tassert(res.conflicts == std::vector<std::string>{"three"} &&
+            ours.at("three").comment() == "ours three" &&
+            ours.at(std::string("three") + pwdb::conflict_suffix).comment() ==
+            "theirs three", "Conflict keeps both");
+
+    // Merging again changes nothing
+    auto again = pwdb::db_merge3(ours, base.pb(), theirs.pb(),
+            pwdb::merge_policy::ours);
+    ret |= tassert(again.changed.empty() && ours.size() == 6,
+            "Idempotent merge");
+
+    return ret;
+}
+
+int
+digest_test(void)
+{
+    bool ret = 0;
+    // FIPS 180-4 examples, and a multi-block update split mid-block
+    using pwdb::sha256;
+    ret |= tassert(pwdb::to_hex(sha256::hash("")) == "e3b0c44298fc1c149afb"
+            "f4c8996fb92427ae41e4649b934ca495991b7852b855", "SHA-256 empty");
+    ret |= tassert(pwdb::to_hex(sha256::hash("abc")) == "ba7816bf8f01cfea4141"
+            "40de5dae2223b00361a396177a9cb410ff61f20015ad", "SHA-256 abc");
+    const std::string two_block =
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    ret |= tassert(pwdb::to_hex(sha256::hash(two_block)) == "248d6a61d20638b8"
+            "e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+            "SHA-256 two blocks");
+    const std::string million(1000000, 'a');
+    sha256 h;
+    for(size_t i = 0; i < million.size(); i += 999)
+        h.update(std::string_view{million}.substr(i, 999));
+    ret |= tassert(pwdb::to_hex(h.finish()) == "cdc76e5c9914fb9281a1c7e284d7"
+            "3e67f1809a48a497200e046d39ccc7112cd0", "SHA-256 incremental");
+    // RFC 4231 test cases 2 and 6, the latter with a key longer than a block
+    ret |= tassert(pwdb::to_hex(pwdb::hmac_sha256{"Jefe"}
+                .update("what do ya want for nothing?").finish()) ==
+            "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843",
+            "HMAC-SHA-256");
+    ret |= tassert(pwdb::to_hex(pwdb::hmac_sha256{std::string(131, '\xaa')}
+                .update("Test Using Larger Than Block-Size Key - Hash Key "
+                    "First").finish()) == "60e431591ee0b67f0d8a26aacbf5b77f"
+            "8e0bc6213728c5140546040f0ee37f54", "HMAC-SHA-256 long key");
+
+    // Record digests cover payload, comment, recipients, and tags
+    const pwdb::db cdb{gen_test_recordv()};
+    auto digests = pwdb::record_digests(cdb.pb());
+    ret |= tassert(digests.size() == 4 &&
+            digests.at("one") != digests.at("two"), "Record digests");
+    pwdb::db other{cdb.copy()};
+    ret |= tassert(pwdb::record_digests(other.pb()) == digests,
+            "Record digests stable");
+    other.entag("four", "new tag");
+    other.comment("three", "changed");
+    auto other_digests = pwdb::record_digests(other.pb());
+    ret |= tassert(other_digests.at("one") == digests.at("one") &&
+            other_digests.at("three") != digests.at("three") &&
+            other_digests.at("four") != digests.at("four"),
+            "Record digests changed");
+
+    // Keyed digests of stores and of the DB ignore map order and the merkle
+    // tree, and cover the keys a store is encrypted to
+    pwdb::pb::Store store, same;
+    (*store.mutable_values())["a"] = "1";
+    (*store.mutable_values())["b"] = "2";
+    (*same.mutable_values())["b"] = "2";
+    (*same.mutable_values())["a"] = "1";
+    ret |= tassert(pwdb::store_digest(store, {"F1", "F2"}) ==
+            pwdb::store_digest(same, {"F2", "F1"}), "Store digest stable");
+    ret |= tassert(pwdb::store_digest(store, {"F1"}) !=
+            pwdb::store_digest(store, {"F2"}) &&
+            pwdb::store_digest(store, {}) != pwdb::store_digest(store, {"F1"}),
+            "Store digest keys");
+    (*same.mutable_values())["a"] = "3";
+    ret |= tassert(pwdb::store_digest(store, {}) !=
+            pwdb::store_digest(same, {}), "Store digest changed");
+    other = cdb.copy();
+    other.merkle(pwdb::merkle_build(other.pb()));
+    ret |= tassert(pwdb::db_digest(other.pb()) == pwdb::db_digest(cdb.pb()),
+            "DB digest ignores merkle");
+    other.comment("one", "changed");
+    ret |= tassert(pwdb::db_digest(other.pb()) != pwdb::db_digest(cdb.pb()),
+            "DB digest changed");
+    other = cdb.copy();
+    other.key_pin(cdb.uid(), {"0123456789ABCDEF"});
+    ret |= tassert(pwdb::db_digest(other.pb()) != pwdb::db_digest(cdb.pb()),
+            "DB digest of key pins");
+
+    return ret;
+}
+
+int
+merge2_test(void)
+{
+    bool ret = 0;
+    const pwdb::db base{gen_test_recordv()};
+
+    // theirs: modify one, add five, remove four, retag, re-encrypt two
+    pwdb::db theirs{base.copy()};
+    theirs.comment("one", "theirs one");
+    theirs.add("five");
+    theirs.entag("five", "one two");
+    theirs.remove("four");
+    theirs.entag("three", "three");
+    theirs.set_data("two", "Two encrypted again");
+
+    pwdb::db ours{base.copy()};
+    std::vector<std::string> compared;
+    auto same_store = [&compared](const pwdb::pb::Record &o,
+            const pwdb::pb::Record &t) {
+        compared.push_back(o.comment());
+        return t.data() == "Two encrypted again";
+    };
+    auto res = pwdb::db_merge(ours, theirs.pb(), pwdb::merge_policy::both,
+            same_store);
+    ret |= tassert(compared.size() == 1, "Compare stores only on conflict");
+    ret |= tassert(res.conflicts == std::vector<std::string>{"one"} &&
+            ours.at("one").comment() == "www.record_one.com" &&
+            ours.at(std::string("one") + pwdb::conflict_suffix).comment() ==
+            "theirs one", "Conflict keeps both");
+    ret |= tassert(ours.count("five") == 1 && ours.count("four") == 1,
+            "Add without remove");
+    ret |= tassert(ours.tags("five").count("one two") == 1 &&
+            ours.tags("three").count("three") == 1 &&
+            ours.tags("one" + std::string(pwdb::conflict_suffix)).count(
+                "one two") == 1, "Their tags");
+    ret |= tassert(ours.get_data("two") == base.get_data("two"),
+            "Same store kept");
+
+    auto again = pwdb::db_merge(ours, theirs.pb(), pwdb::merge_policy::theirs,
+            same_store);
+    ret |= tassert(again.changed == std::vector<std::string>{"one"} &&
+            ours.at("one").comment() == "theirs one", "Take theirs");
+
+    // Merging again changes nothing
+    auto third = pwdb::db_merge(ours, theirs.pb(), pwdb::merge_policy::both,
+            same_store);
+    ret |= tassert(third.changed.empty() && third.conflicts.empty(),
+            "Idempotent merge");
+
+    return ret;
+}
+
+int
+merkle_test(void)
+{
+    bool ret = 0;
+    pwdb::db ours{};
+    for(int i = 0; i != 200; ++i) {
+        pwdb::pb::Record rcd{};
+        rcd.set_data("Encrypted " + std::to_string(i));
+        ours.add("record " + std::to_string(i), std::move(rcd));
+    }
+    ours.entag("record 7", "seven");
+    auto tree = pwdb::merkle_build(ours.pb());
+    ret |= tassert(tree.depth() == 5 && tree.node_size() == 63 &&
+            tree.leaf_size() == 32, "Tree shape");
+    ours.merkle(pwdb::merkle_build(ours.pb()));
+    ret |= tassert(pwdb::merkle_root(ours.pb()).size() == 64 &&
+            pwdb::merkle_root(ours.pb()) == pwdb::merkle_root(pwdb::db{
+                pwdb::pb::DB{ours.pb()}}.pb()), "Stored root");
+
+    // theirs: add, change data, and retag; tree left stale
+    using vs = std::vector<std::string>;
+    pwdb::db theirs{ours.copy()};
+    theirs.add("record 200");
+    theirs.set_data("record 42", "Encrypted again");
+    theirs.detag("record 7", "seven");
+    auto diff = pwdb::merkle_diff(ours.pb(), theirs.pb());
+    ret |= tassert(diff.added == vs{"record 200"} && diff.removed.empty() &&
+            diff.changed == vs{"record 42", "record 7"},
+            "Stale tree of another size rebuilt");
+
+    // Same size, but a differing leaf names a record since removed
+    theirs.set_data("record 3", "Encrypted later");
+    theirs.merkle(pwdb::merkle_build(theirs.pb()));
+    theirs.remove("record 3");
+    theirs.add("record 201");
+    const auto expect = [](const pwdb::db_diff &d) {
+        return d.added == vs{"record 200", "record 201"} &&
+            d.removed == vs{"record 3"} &&
+            d.changed == vs{"record 42", "record 7"};
+    };
+    ret |= tassert(expect(pwdb::merkle_diff(ours.pb(), theirs.pb())),
+            "Stale tree naming a missing record rebuilt");
+
+    theirs.merkle(pwdb::merkle_build(theirs.pb()));
+    diff = pwdb::merkle_diff(ours.pb(), theirs.pb());
+    ret |= tassert(expect(diff), "Diff stored trees");
+
+    // Without stored trees, or at another depth, trees are rebuilt
+    theirs.merkle(pwdb::merkle_build(theirs.pb(), 2));
+    auto rebuilt = pwdb::merkle_diff(pwdb::pb::DB{}, theirs.pb());
+    ret |= tassert(rebuilt.added.size() == 201 && rebuilt.removed.empty(),
+            "Diff against empty");
+    auto redepth = pwdb::merkle_diff(ours.pb(), theirs.pb());
+    ret |= tassert(redepth.added == diff.added &&
+            redepth.removed == diff.removed &&
+            redepth.changed == diff.changed, "Diff rebuilt tree");
+
+    return ret;
+}
+
+int
+store_cache_test(void)
+{
+    using namespace std::chrono_literals;
+    bool ret = 0;
+    auto make_store = [](const std::string &pw) {
+        pwdb::pb::Store store;
+        (*store.mutable_values())["password"] = pw;
+        return store;
+    };
+    auto password = [](const std::optional<pwdb::pb::Store> &store) {
+        return store ? store->values().at("password") : std::string{};
+    };
+
+    pwdb::store_cache cache{};
+    cache.insert("one", "cipher one", make_store("pw one"), {"KEYID1"});
+    std::vector<std::string> keyids;
+    ret |= tassert(password(cache.find("one", "cipher one", &keyids)) ==
+            "pw one" && keyids == std::vector<std::string>{"KEYID1"}, "Hit");
+    ret |= tassert(!cache.find("one", "cipher one again"),
+            "Miss on changed ciphertext");
+    ret |= tassert(!cache.find("two", "cipher one"), "Miss on name");
+    cache.erase("one");
+    ret |= tassert(!cache.find("one", "cipher one"), "Miss after erase");
+    auto st = cache.stats();
+    ret |= tassert(st.hits == 1 && st.misses == 3 && st.entries == 0 &&
+            st.bytes == 0, "Counts");
+
+    // Least recently used are evicted beyond the size cap
+    const auto size = make_store("pw 0").ByteSizeLong();
+    pwdb::store_cache small{3 * size};
+    for(int i = 0; i != 3; ++i) {
+        auto n = std::to_string(i);
+        small.insert(n, "cipher " + n, make_store("pw " + n));
+    }
+    (void)small.find("0", "cipher 0");
+    small.insert("3", "cipher 3", make_store("pw 3"));
+    st = small.stats();
+    ret |= tassert(st.entries == 3 && st.bytes == 3 * size &&
+            st.evictions == 1, "Size cap");
+    ret |= tassert(password(small.find("0", "cipher 0")) == "pw 0" &&
+            !small.find("1", "cipher 1"), "Evict least recently used");
+
+    // Entries expire ttl after being added, used or not
+    pwdb::store_cache brief{pwdb::store_cache::default_max_bytes, 20ms};
+    brief.insert("one", "cipher one", make_store("pw one"));
+    ret |= tassert(brief.find("one", "cipher one").has_value(),
+            "Hit before ttl");
+    std::this_thread::sleep_for(30ms);
+    brief.expire();
+    st = brief.stats();
+    ret |= tassert(st.entries == 0 && st.expirations == 1, "Expired");
+
+    // Buffers are on pages of their own, so freeing one unlocks no other
+    const auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    pwdb::locked_buffer a{"secret a"}, b{"secret b"};
+    const auto a_addr = reinterpret_cast<uintptr_t>(a.view().data());
+    const auto b_addr = reinterpret_cast<uintptr_t>(b.view().data());
+    ret |= tassert(a_addr % page == 0 && b_addr % page == 0 &&
+            a_addr != b_addr, "Buffer pages");
+    a = pwdb::locked_buffer{};
+    ret |= tassert(b.view() == "secret b" && a.size() == 0, "Buffer freed");
+
+    return ret;
+}
+
+int
+completion_test(void)
+{
+    using vs = std::vector<std::string>;
+    bool ret = 0;
+
+    pwdb::name_trie t;
+    for(auto n: {"bank", "banker", "band", "bandit", "b", "car", "bank"})
+        t.insert(n);
+    ret |= tassert(t.size() == 6, "Trie insert");
+    ret |= tassert(t.complete("ban") ==
+            vs{"band", "bandit", "bank", "banker"}, "Trie prefix");
+    ret |= tassert(t.complete("bandi") == vs{"bandit"}, "Trie within label");
+    ret |= tassert(t.complete("") ==
+            vs{"b", "band", "bandit", "bank", "banker", "car"}, "Trie all");
+    ret |= tassert(t.complete("bx").empty() && t.complete("bankers").empty(),
+            "Trie no match");
+    ret |= tassert(t.erase("bank") && !t.erase("bank") && !t.erase("ba") &&
+            t.contains("banker") && !t.contains("bank"), "Trie erase");
+    ret |= tassert(t.erase("band") && t.complete("band") == vs{"bandit"},
+            "Trie erase with child");
+    auto copy = t;
+    for(auto n: {"b", "banker", "bandit", "car"})
+        t.erase(n);
+    ret |= tassert(t.size() == 0 && t.complete("").empty() &&
+            copy.complete("b") == vs{"b", "bandit", "banker"}, "Trie copy");
+
+    // The tries of db follow its changes once built
+    auto cdb = gen_test_recordv();
+    ret |= tassert(cdb.complete_name("t") == vs{"three", "two"},
+            "Complete name");
+    ret |= tassert(cdb.complete_tag("") == vs{"one two", "two three"},
+            "Complete tag");
+    cdb.add("twelve");
+    cdb.entag("twelve", "twelve");
+    ret |= tassert(cdb.complete_name("tw") == vs{"twelve", "two"} &&
+            cdb.complete_tag("tw") == vs{"twelve", "two three"},
+            "Complete after add");
+    cdb.remove("twelve");
+    cdb.detag("one", "one two");
+    cdb.detag("two", "one two");
+    ret |= tassert(cdb.complete_name("tw") == vs{"two"} &&
+            cdb.complete_tag("") == vs{"two three"}, "Complete after remove");
+    cdb = pwdb::pb::DB{};
+    ret |= tassert(cdb.complete_name("").empty() &&
+            cdb.complete_tag("").empty(), "Complete after assign");
+
+    return ret;
+}
+
+int
+latency_test(void)
+{
+    using namespace std::chrono_literals;
+    bool ret = 0;
+
+    pwdb::latency_histogram h;
+    h.add(500ns);
+    h.add(1us);
+    h.add(3us);
+    h.add(1500us);
+    h.add(1h);
+    ret |= tassert(h.count() == 5 && h.max() == 1h &&
+            h.total() == 1h + 1504us + 500ns, "Summary");
+    ret |= tassert(h.bucket(0) == 2 && h.bucket(1) == 1 && h.bucket(10) == 1 &&
+            h.bucket(h.buckets - 1) == 1, "Buckets");
+    ret |= tassert(h.bucket_floor(10) == 1024us, "Bucket floor");
+    ret |= tassert(pwdb::format_duration(850us) == "850us" &&
+            pwdb::format_duration(1500us) == "1.50ms" &&
+            pwdb::format_duration(2500ms) == "2.50s", "Format");
+
+    pwdb::latency_stats stats;
+    ret |= tassert(stats.empty(), "Empty");
+    std::vector<std::thread> threads;
+    for(int t = 0; t != 4; ++t) {
+        threads.emplace_back([&stats]() {
+            for(int i = 0; i != 100; ++i)
+                stats.add(i % 2 ? "odd" : "even", 1ms);
+        });
+    }
+    for(auto &t: threads)
+        t.join();
+    auto hs = stats.histograms();
+    ret |= tassert(hs.size() == 2 && hs.at("odd").count() == 200 &&
+            hs.at("even").bucket(9) == 200, "Several threads");
+
+    std::string out;
+    pwdb::print_latency(out, "test", stats);
+    ret |= tassert(out.starts_with("test:\n    even: 200, mean 1.00ms, "
+                "max 1.00ms\n      >=    512us ####"), "Print");
+
+    return ret;
+}
+
+int
+trace_test(void)
+{
+    bool ret = 0;
+    const auto file = std::filesystem::temp_directory_path() /
+        ("pwdb_trace_test." + std::to_string(getpid()) + ".json");
+
+    unsetenv("PWDB_TRACE");
+    {
+        pwdb::trace_session session;
+        pwdb::trace_span span{"untraced"};
+        ret |= tassert(!pwdb::trace_session::active(), "Off when unset");
+    }
+    ret |= tassert(!std::filesystem::exists(file), "No file when unset");
+
+    setenv("PWDB_TRACE", file.c_str(), 1);
+    {
+        pwdb::trace_session session;
+        ret |= tassert(pwdb::trace_session::active(), "On when set");
+        pwdb::trace_span outer{"outer", "a \"quoted\" detail"};
+        std::thread([]() { pwdb::trace_span inner{"inner"}; }).join();
+    }
+    unsetenv("PWDB_TRACE");
+    ret |= tassert(!pwdb::trace_session::active(), "Off after session");
+
+    const auto perms = std::filesystem::status(file).permissions();
+    ret |= tassert((perms & std::filesystem::perms::all) ==
+            (std::filesystem::perms::owner_read |
+             std::filesystem::perms::owner_write), "Owner only file");
+    std::ifstream ifs{file};
+    const std::string json{std::istreambuf_iterator<char>{ifs},
+        std::istreambuf_iterator<char>{}};
+    std::filesystem::remove(file);
+    ret |= tassert(json.starts_with("{\"traceEvents\":[{\"name\":\"inner\","),
+            "Events in order of ending");
+    ret |= tassert(json.find("\"name\":\"outer\",\"cat\":\"pwdb\","
+                "\"ph\":\"X\",\"ts\":") != json.npos &&
+            json.find("\"args\":{\"detail\":\"a \\\"quoted\\\" "
+                "detail\"}") != json.npos, "Complete events");
+    ret |= tassert(json.find("untraced") == json.npos, "Only while active");
+
+    return ret;
+}
+
+static void
+write_file(const std::filesystem::path &file, const std::string &content)
+{
+    std::ofstream ofs{file, std::ios::trunc};
+    ofs << content;
+}
+
+int
+file_watch_test(void)
+{
+    using namespace std::chrono_literals;
+    bool ret = 0;
+    const auto dir = std::filesystem::temp_directory_path() /
+        ("pwdb_watch_test." + std::to_string(getpid()));
+    std::filesystem::create_directory(dir);
+    const auto file = dir / "db";
+    ret |= tassert(!pwdb::get_file_generation(file).exists, "Missing file");
+    write_file(file, "first");
+    auto gen = pwdb::get_file_generation(file);
+    ret |= tassert(gen.exists && gen.size == 5, "File generation");
+
+    pwdb::file_watch watch{file};
+    ret |= tassert(!watch.wait(0ms), "Unchanged");
+
+    // Replaced by rename, as lock_overwrite_file does
+    write_file(dir / "db.tmp", "second");
+    std::filesystem::rename(dir / "db.tmp", file);
+    ret |= tassert(watch.wait(1s), "Replace seen");
+    auto new_gen = pwdb::get_file_generation(file);
+    ret |= tassert(new_gen != gen && new_gen.ino != gen.ino, "Replaced");
+    gen = new_gen;
+
+    // Rewritten in place
+    write_file(file, "third version");
+    ret |= tassert(watch.wait(1s), "Rewrite seen");
+    new_gen = pwdb::get_file_generation(file);
+    ret |= tassert(new_gen != gen && new_gen.ino == gen.ino &&
+            new_gen.size == 13, "Rewritten");
+
+    // Other files in the directory are not the watched file
+    write_file(dir / "sibling", "other");
+    std::filesystem::rename(dir / "sibling", dir / "sibling.2");
+    ret |= tassert(!watch.wait(100ms), "Sibling ignored");
+    ret |= tassert(pwdb::get_file_generation(file) == new_gen,
+            "Sibling leaves generation");
+
+    std::filesystem::remove_all(dir);
+    return ret;
+}
+
 int
 main(int argc, const char *argv[])
 {
@@ -140,6 +667,24 @@ main(int argc, const char *argv[])
         return add_remove_test();
     if(test_name == "tags")
         return tags_test();
+    if(test_name == "merge3")
+        return merge3_test();
+    if(test_name == "digest")
+        return digest_test();
+    if(test_name == "merge2")
+        return merge2_test();
+    if(test_name == "merkle")
+        return merkle_test();
+    if(test_name == "store_cache")
+        return store_cache_test();
+    if(test_name == "completion")
+        return completion_test();
+    if(test_name == "latency")
+        return latency_test();
+    if(test_name == "trace")
+        return trace_test();
+    if(test_name == "file_watch")
+        return file_watch_test();
 
     return 0;
 }